@@ -0,0 +1,143 @@
+#include "assets.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <profile/profile.h>
+
+static std::mutex lock;
+/* guarded by lock */
+static std::deque<std::function<void(void)>> queue;
+static bool quit;
+/* threads to start by the first submit(), 0 without init() */
+static unsigned thread_count;
+static std::vector<std::thread> threads;
+static std::condition_variable wakeup;
+
+static void loader_main(void)
+{
+	for (;;) {
+		std::function<void(void)> load;
+		{
+			std::unique_lock<std::mutex> lk(lock);
+			wakeup.wait(lk, [] { return !queue.empty() || quit; });
+			/* finish queued loads before quitting */
+			if (queue.empty())
+				return;
+			load = std::move(queue.front());
+			queue.pop_front();
+		}
+		load();
+	}
+}
+
+int assets::init(unsigned count)
+{
+	release();
+
+	if (count == 0)
+		count = std::max(1u, std::thread::hardware_concurrency());
+
+	std::lock_guard<std::mutex> g(lock);
+	thread_count = count;
+	return 0;
+}
+
+void assets::release(void)
+{
+	std::vector<std::thread> stopped;
+	{
+		std::lock_guard<std::mutex> g(lock);
+		quit = true;
+		thread_count = 0;
+		stopped.swap(threads);
+		wakeup.notify_all();
+	}
+	for (auto& t : stopped)
+		t.join();
+
+	std::lock_guard<std::mutex> g(lock);
+	quit = false;
+}
+
+void assets::submit(std::function<void(void)> load)
+{
+	std::lock_guard<std::mutex> g(lock);
+	queue.push_back(std::move(load));
+
+	/* started on demand: nothing runs if nothing is loaded */
+	if (threads.empty()) {
+		for (unsigned i = 0; i < thread_count; i++)
+			threads.emplace_back(loader_main);
+	}
+	wakeup.notify_one();
+}
+
+bool assets::run_one(void)
+{
+	std::function<void(void)> load;
+	{
+		std::lock_guard<std::mutex> g(lock);
+		if (queue.empty())
+			return false;
+		load = std::move(queue.front());
+		queue.pop_front();
+	}
+	load();
+	return true;
+}
+
+/* Decode the full resolution of an opened texture */
+static std::future<textures::id_t> decode(textures::id_t id)
+{
+	return assets::async([id] {
+		PROFILE_ZONE("load texture");
+		textures::get(id, 0);
+		return id;
+	});
+}
+
+std::future<textures::id_t> assets::load_texture(const char *filename)
+{
+	return async([filename = std::string(filename)] {
+		textures::id_t id = textures::open(filename.c_str());
+		if (id != textures::NONE) {
+			PROFILE_ZONE("load texture");
+			textures::get(id, 0);
+		}
+		return id;
+	});
+}
+
+std::future<model_t> assets::load_model(const char *model_filename, const char *texture_filename, bool optimize)
+{
+	/* queued first: decoded while the model is parsed */
+	auto texture = load_texture(texture_filename);
+
+	return async([model_filename = std::string(model_filename), texture_filename = std::string(texture_filename),
+		texture = std::move(texture), optimize] {
+		model_t obj(model_filename.c_str(), texture_filename.c_str());
+
+		/* textures of materials are known once the model is parsed */
+		std::vector<textures::id_t> ids;
+		std::vector<std::future<textures::id_t>> maps;
+		for (const auto& m : obj.materials_) {
+			if (m.texture == textures::NONE || m.texture == obj.texture_id_ ||
+				std::find(ids.begin(), ids.end(), m.texture) != ids.end())
+				continue;
+			ids.push_back(m.texture);
+			maps.push_back(decode(m.texture));
+		}
+
+		if (obj.is_loaded() && optimize)
+			obj.optimize();
+
+		wait(texture);
+		for (const auto& map : maps)
+			wait(map);
+		return obj;
+	});
+}
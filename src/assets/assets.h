@@ -0,0 +1,116 @@
+#ifndef ASSETS_ASSETS_H_
+#define ASSETS_ASSETS_H_
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <model/model.h>
+#include <textures/textures.h>
+
+/* Asynchronous asset loading
+ *
+ * Models and textures are loaded by a pool of loader threads, separate from
+ * the job system: a load blocks on file I/O and runs for a long time, it
+ * mustn't hold up the jobs of a frame. A load returns a future right away, so
+ * assets are loaded in parallel and the caller polls is_ready() each frame or
+ * waits for the ones it needs. Loading several assets takes about as long as
+ * the slowest one.
+ *
+ *	auto head = assets::load_model("head.obj", "head.tga", true);
+ *	auto floor = assets::load_model("floor.obj", "floor.tga", true);
+ *	...
+ *	if (assets::is_ready(head))
+ *		obj = head.get();
+ */
+namespace assets {
+
+/** Initialize the pool of loader threads
+ * The threads are started by the first load, so a program which ends up
+ * loading nothing this way doesn't keep idle threads.
+ *
+ * @param threads: number of loader threads. 0 - one per hardware thread.
+ * @return 0 on success.
+ *
+ * @note Without init() loads are executed by wait() on the calling thread.
+ */
+int init(unsigned threads = 0);
+
+/** Stop loader threads
+ * Queued loads are finished before the threads stop.
+ *
+ * @note It's safe to invoke the function if init() failed or has never been
+ * invoked.
+ */
+void release(void);
+
+/** Queue a load for a loader thread. See async() */
+void submit(std::function<void(void)> load);
+
+/** Execute a queued load on the calling thread
+ *
+ * @return false if the queue is empty.
+ */
+bool run_one(void);
+
+/** Run f() on a loader thread
+ *
+ * @return the future of the result of f().
+ */
+template <typename F>
+auto async(F f) -> std::future<decltype(f())>
+{
+	using T = decltype(f());
+	auto task = std::make_shared<std::packaged_task<T(void)>>(std::move(f));
+	auto future = task->get_future();
+	submit([task] { (*task)(); });
+	return future;
+}
+
+/** Check if a future is ready without blocking */
+template <typename T>
+bool is_ready(const std::future<T>& future)
+{
+	return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+/** Execute queued loads on the calling thread until a future is ready
+ * A loader thread waiting for other loads this way doesn't hold a thread of
+ * the pool idle.
+ */
+template <typename T>
+void wait(const std::future<T>& future)
+{
+	while (!is_ready(future)) {
+		/* the load may be queued behind others or started by another
+		 * thread: help with the queue, then block for a while
+		 */
+		if (!run_one())
+			future.wait_for(std::chrono::milliseconds(1));
+	}
+}
+
+/** Load a texture and decode its full resolution to the texture cache
+ *
+ * @param filename: .tga file.
+ * @return the future of the texture, textures::NONE if the file can't be
+ * opened.
+ */
+std::future<textures::id_t> load_texture(const char *filename);
+
+/** Load a model
+ * The texture is decoded in parallel with parsing of the model, textures of
+ * its materials once they're known. The model is ready when all of them are
+ * in the texture cache.
+ *
+ * @param model_filename: .obj file.
+ * @param texture_filename: .tga texture.
+ * @param optimize: optimize the model for rendering, see
+ * model_t::optimize().
+ * @return the future of the model, check model_t::is_loaded().
+ */
+std::future<model_t> load_model(const char *model_filename, const char *texture_filename, bool optimize);
+
+} /* namespace assets */
+
+#endif /* ASSETS_ASSETS_H_ */
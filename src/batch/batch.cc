@@ -0,0 +1,253 @@
+#include "batch.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <display/display.h>
+#include <jobs/jobs.h>
+#include <render/render.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+/* frames being encoded while the next ones are rendered */
+static constexpr unsigned SLOTS = 4;
+/* rows encoded by a job. Even, so 4:2:0 chroma rows don't span jobs */
+static constexpr size_t GRAIN = 16;
+
+/* A frame read back from the frame buffer */
+struct slot_t {
+	std::vector<uint32_t> pixels;
+	/* filled by the encoder jobs */
+	mutable std::vector<uint8_t> data;
+	batch::format fmt;
+	int width;
+	int height;
+	unsigned frame;
+	/* parent of the encoder jobs, nullptr if the slot is free */
+	jobs::job_t *job;
+};
+
+static uint8_t luma(int r, int g, int b)
+{
+	return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static uint8_t chroma_u(int r, int g, int b)
+{
+	return (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+static uint8_t chroma_v(int r, int g, int b)
+{
+	return (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+static void encode_ppm(const slot_t& s, size_t begin, size_t end)
+{
+	for (size_t y = begin; y < end; y++) {
+		const uint32_t *src = &s.pixels[y * s.width];
+		uint8_t *dst = &s.data[y * s.width * 3];
+
+		for (int x = 0; x < s.width; x++) {
+			*dst++ = (uint8_t)(src[x] >> 16);
+			*dst++ = (uint8_t)(src[x] >> 8);
+			*dst++ = (uint8_t)src[x];
+		}
+	}
+}
+
+/* Planar Y, U, V. Chroma is the average of 2x2 pixels, the last column and
+ * row are repeated for odd sizes
+ */
+static void encode_y4m(const slot_t& s, size_t begin, size_t end)
+{
+	size_t w = s.width;
+	size_t h = s.height;
+	size_t cw = (w + 1) / 2;
+	size_t ch = (h + 1) / 2;
+	uint8_t *plane_y = s.data.data();
+	uint8_t *plane_u = plane_y + w * h;
+	uint8_t *plane_v = plane_u + cw * ch;
+
+	for (size_t y = begin; y < end; y++) {
+		const uint32_t *src = &s.pixels[y * w];
+		for (size_t x = 0; x < w; x++)
+			plane_y[y * w + x] = luma((src[x] >> 16) & 0xFF, (src[x] >> 8) & 0xFF, src[x] & 0xFF);
+	}
+
+	for (size_t cy = begin / 2; cy < (end + 1) / 2; cy++) {
+		const uint32_t *r0 = &s.pixels[2 * cy * w];
+		const uint32_t *r1 = 2 * cy + 1 < h ? r0 + w : r0;
+
+		for (size_t cx = 0; cx < cw; cx++) {
+			size_t x0 = 2 * cx;
+			size_t x1 = x0 + 1 < w ? x0 + 1 : x0;
+			int r = 0, g = 0, b = 0;
+			for (uint32_t c : { r0[x0], r0[x1], r1[x0], r1[x1] }) {
+				r += (c >> 16) & 0xFF;
+				g += (c >> 8) & 0xFF;
+				b += c & 0xFF;
+			}
+			r = (r + 2) / 4;
+			g = (g + 2) / 4;
+			b = (b + 2) / 4;
+			plane_u[cy * cw + cx] = chroma_u(r, g, b);
+			plane_v[cy * cw + cx] = chroma_v(r, g, b);
+		}
+	}
+}
+
+static void encode_job(const void *ctx, size_t begin, size_t end)
+{
+	auto s = static_cast<const slot_t *>(ctx);
+
+	if (s->fmt == batch::format::ppm)
+		encode_ppm(*s, begin, end);
+	else
+		encode_y4m(*s, begin, end);
+}
+
+/* Copy the presented frame to a slot and start encoding */
+static void capture(slot_t& s, unsigned frame, batch::format fmt)
+{
+	auto fb = display::get_presented();
+	size_t w = fb.width;
+	size_t h = fb.height;
+
+	/* the frame buffer is tiled, slots are linear */
+	s.pixels.resize(w * h);
+	for (size_t y = 0; y < h; y++)
+		fb.read_row((int)y, &s.pixels[y * w]);
+	if (fmt == batch::format::ppm)
+		s.data.resize(w * h * 3);
+	else
+		s.data.resize(w * h + 2 * ((w + 1) / 2) * ((h + 1) / 2));
+	s.fmt = fmt;
+	s.width = fb.width;
+	s.height = fb.height;
+	s.frame = frame;
+
+	s.job = jobs::create(static_cast<jobs::job_fn>([](const void *, size_t, size_t) {}), nullptr);
+	for (size_t begin = 0; begin < h; begin += GRAIN)
+		jobs::submit(jobs::create(encode_job, &s, begin, begin + GRAIN < h ? begin + GRAIN : h, s.job));
+	jobs::submit(s.job);
+}
+
+/* Wait for a slot to be encoded and write it out if write is set
+ *
+ * @return 0 on success.
+ */
+static int finish(slot_t& s, const char *output, std::FILE *stream, bool write)
+{
+	if (!s.job)
+		return 0;
+	jobs::wait(s.job);
+	s.job = nullptr;
+	if (!write)
+		return 0;
+
+	if (s.fmt == batch::format::y4m) {
+		if (std::fputs("FRAME\n", stream) < 0 ||
+				std::fwrite(s.data.data(), 1, s.data.size(), stream) != s.data.size()) {
+			std::fprintf(stderr, "Failed to write frame %u\n", s.frame);
+			return 1;
+		}
+		return 0;
+	}
+
+	char name[1024];
+	std::snprintf(name, sizeof(name), "%s%04u.ppm", output, s.frame);
+	std::FILE *f = std::fopen(name, "wb");
+	if (!f) {
+		std::fprintf(stderr, "Failed to open \"%s\"\n", name);
+		return 1;
+	}
+
+	int ret = 0;
+	if (std::fprintf(f, "P6\n%d %d\n255\n", s.width, s.height) < 0 ||
+			std::fwrite(s.data.data(), 1, s.data.size(), f) != s.data.size()) {
+		std::fprintf(stderr, "Failed to write \"%s\"\n", name);
+		ret = 1;
+	}
+	if (std::fclose(f))
+		ret = 1;
+
+	return ret;
+}
+
+int batch::run(unsigned frames, format fmt, const char *output, unsigned fps,
+	draw_fn draw, const void *ctx, stats_t *stats)
+{
+	std::FILE *stream = nullptr;
+
+	if (fmt == format::y4m) {
+		if (!std::strcmp(output, "-")) {
+			stream = stdout;
+#ifdef _WIN32
+			_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		} else if (!(stream = std::fopen(output, "wb"))) {
+			std::fprintf(stderr, "Failed to open \"%s\"\n", output);
+			return 1;
+		}
+
+		auto [w, h] = display::get_resolution();
+		std::fprintf(stream, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C420jpeg\n", w, h, fps);
+	}
+
+	bool pipelined = render::is_pipelining_enabled();
+	render::pipelining_enable(true);
+
+	slot_t slots[SLOTS] = {};
+	int ret = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	/* update() of frame i presents frame i - 1, flush() the last one */
+	for (unsigned i = 0; i <= frames; i++) {
+		if (i < frames) {
+			render::clear();
+			draw(ctx, i);
+			render::update();
+		} else {
+			render::flush();
+		}
+		if (i == 0)
+			continue;
+
+		/* the slot holds frame i - 1 - SLOTS, all the previous ones are
+		 * written
+		 */
+		slot_t& s = slots[(i - 1) % SLOTS];
+		if ((ret = finish(s, output, stream, true))) {
+			render::flush();
+			break;
+		}
+		capture(s, i - 1, fmt);
+	}
+	/* the rest in order */
+	for (unsigned i = frames; i < frames + SLOTS; i++) {
+		if (finish(slots[i % SLOTS], output, stream, !ret))
+			ret = 1;
+	}
+
+	std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+	if (stats) {
+		stats->frames = frames;
+		stats->seconds = elapsed.count();
+		stats->fps = elapsed.count() > 0.f ? frames / elapsed.count() : 0.f;
+	}
+
+	render::pipelining_enable(pipelined);
+
+	if (stream == stdout) {
+		if (std::fflush(stdout))
+			ret = 1;
+	} else if (stream && std::fclose(stream)) {
+		ret = 1;
+	}
+
+	return ret;
+}
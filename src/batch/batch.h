@@ -0,0 +1,62 @@
+#ifndef BATCH_BATCH_H_
+#define BATCH_BATCH_H_
+
+/* Offline rendering
+ *
+ * Frames are pipelined (see render::pipelining_enable()): the geometry of a
+ * frame is processed while the previous one is rasterized, and a rendered
+ * frame is read back from the headless display and encoded by jobs while the
+ * next ones are rendered, then written out in order. All the threads of the
+ * job system work on the frames in flight. The display must be headless (see
+ * render::init()), a window keeps no copy of a presented frame.
+ */
+namespace batch {
+
+enum class format {
+	ppm, /**< binary PPM images <prefix>0000.ppm, <prefix>0001.ppm, ... */
+	y4m, /**< YUV4MPEG2 stream, 4:2:0 BT.601 */
+};
+
+/** Draw a frame: called between render::clear() and render::update()
+ *
+ * @param ctx: passed to run() as is.
+ * @param frame: frame number, from 0.
+ */
+using draw_fn = void (*)(const void *ctx, unsigned frame);
+
+struct stats_t {
+	unsigned frames;
+	float seconds;  /**< from the first frame to the last one written */
+	float fps;      /**< frames per second */
+};
+
+/** Render and write out a sequence of frames
+ * Pipelining is enabled for the run. Other render settings are used as is,
+ * so for repeatable output disable dynamic resolution with
+ * render::set_target_frame_time(0). Frames are in flight after draw()
+ * returns: data it passes to the renderer must be valid till draw() of the
+ * next frame returns.
+ *
+ * @param frames: number of frames to render.
+ * @param fmt: output format.
+ * @param output: path prefix of image files for ppm, file name for y4m or
+ * "-" to write the stream to stdout.
+ * @param fps: frame rate written to the y4m stream header.
+ * @param draw, ctx: a function to draw a frame.
+ * @param stats: where to store throughput statistics or nullptr.
+ * @return 0 on success.
+ */
+int run(unsigned frames, format fmt, const char *output, unsigned fps,
+	draw_fn draw, const void *ctx, stats_t *stats = nullptr);
+
+/** Render a sequence of frames calling f(frame) to draw them */
+template <typename F>
+int run(unsigned frames, format fmt, const char *output, unsigned fps, const F& f, stats_t *stats = nullptr)
+{
+	auto fn = [](const void *ctx, unsigned frame) { (*static_cast<const F *>(ctx))(frame); };
+	return run(frames, fmt, output, fps, fn, &f, stats);
+}
+
+} /* namespace batch */
+
+#endif /* BATCH_BATCH_H_ */
@@ -0,0 +1,173 @@
+#include "bench.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <matrix.h>
+#include <vector.h>
+
+/* Elements per pass: the data of a benchmark stays in L1/L2 cache */
+constexpr size_t COUNT = 1024;
+constexpr unsigned PASSES = 200;
+/* the best run is reported, the others absorb warm up and preemption */
+constexpr unsigned RUNS = 10;
+
+/* results are summed here, so the compiler can't drop the work */
+static volatile float sink;
+
+/* Generic loops as matrix.h and vector.h have them for other types */
+static mat4x4f_t generic_mul(const mat4x4f_t& a, const mat4x4f_t& b)
+{
+	mat4x4f_t ret{ mat4x4f_t::uninitialized_t{} };
+	for (size_t r = 0; r < 4; r++) {
+		for (size_t c = 0; c < 4; c++) {
+			float sum = 0;
+			for (size_t i = 0; i < 4; i++)
+				sum += a(r, i) * b(i, c);
+			ret(r, c) = sum;
+		}
+	}
+	return ret;
+}
+
+static mat4x1f_t generic_mul(const mat4x4f_t& a, const mat4x1f_t& v)
+{
+	mat4x1f_t ret{ mat4x1f_t::uninitialized_t{} };
+	for (size_t r = 0; r < 4; r++) {
+		float sum = 0;
+		for (size_t i = 0; i < 4; i++)
+			sum += a(r, i) * v(i, 0);
+		ret(r, 0) = sum;
+	}
+	return ret;
+}
+
+static float generic_dot(const vec4f_t& a, const vec4f_t& b)
+{
+	float sum = 0;
+	for (size_t i = 0; i < 4; i++)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+/* Deterministic values in [-1, 1) */
+static float next_value(void)
+{
+	static uint32_t state = 1;
+
+	state = state * 1664525u + 1013904223u;
+	return (float)(state >> 8) / (float)(1u << 23) - 1.f;
+}
+
+/* Time f(), which does ops operations, return nanoseconds per operation */
+template <typename F>
+static double time_ns(size_t ops, const F& f)
+{
+	using namespace std::chrono;
+	double best = 0.;
+
+	for (unsigned run = 0; run < RUNS; run++) {
+		auto start = steady_clock::now();
+		f();
+		double ns = duration<double, std::nano>(steady_clock::now() - start).count() / (double)ops;
+		if (run == 0 || ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+static void report(const char *name, double ns, double generic_ns)
+{
+	std::printf("%-24s %8.2f ns %8.2f ns %6.2fx\n", name, ns, generic_ns, generic_ns / ns);
+}
+
+int bench::run(void)
+{
+#if defined(SIMD_AVX)
+	const char *isa = "AVX";
+#elif defined(SIMD_SSE)
+	const char *isa = "SSE";
+#elif defined(SIMD_NEON)
+	const char *isa = "NEON";
+#else
+	const char *isa = "scalar";
+#endif
+
+	std::vector<mat4x4f_t> a(COUNT), b(COUNT), m(COUNT);
+	std::vector<mat4x1f_t> v(COUNT), mv(COUNT);
+	std::vector<vec4f_t> p(COUNT), tp(COUNT);
+	for (size_t i = 0; i < COUNT; i++) {
+		for (size_t r = 0; r < 4; r++) {
+			for (size_t c = 0; c < 4; c++) {
+				a[i](r, c) = next_value();
+				b[i](r, c) = next_value();
+			}
+			v[i](r, 0) = next_value();
+			p[i][r] = v[i](r, 0);
+		}
+	}
+	const mat4x4f_t& mvp = a[0];
+	const size_t ops = COUNT * PASSES;
+
+	std::printf("%s build, %zu elements, best of %u runs\n", isa, COUNT, RUNS);
+	std::printf("%-24s %11s %11s %7s\n", "", "specialized", "generic", "speedup");
+
+	report("mat4x4 * mat4x4",
+		time_ns(ops, [&] {
+			for (unsigned pass = 0; pass < PASSES; pass++)
+				for (size_t i = 0; i < COUNT; i++)
+					m[i] = a[i] * b[i];
+			sink = sink + m[COUNT - 1](3, 3);
+		}),
+		time_ns(ops, [&] {
+			for (unsigned pass = 0; pass < PASSES; pass++)
+				for (size_t i = 0; i < COUNT; i++)
+					m[i] = generic_mul(a[i], b[i]);
+			sink = sink + m[COUNT - 1](3, 3);
+		}));
+
+	report("mat4x4 * vec4",
+		time_ns(ops, [&] {
+			for (unsigned pass = 0; pass < PASSES; pass++)
+				for (size_t i = 0; i < COUNT; i++)
+					mv[i] = mvp * v[i];
+			sink = sink + mv[COUNT - 1](3, 0);
+		}),
+		time_ns(ops, [&] {
+			for (unsigned pass = 0; pass < PASSES; pass++)
+				for (size_t i = 0; i < COUNT; i++)
+					mv[i] = generic_mul(mvp, v[i]);
+			sink = sink + mv[COUNT - 1](3, 0);
+		}));
+
+	report("transform(), per vertex",
+		time_ns(ops, [&] {
+			for (unsigned pass = 0; pass < PASSES; pass++)
+				transform(mvp, p.data(), tp.data(), COUNT);
+			sink = sink + tp[COUNT - 1][3];
+		}),
+		time_ns(ops, [&] {
+			for (unsigned pass = 0; pass < PASSES; pass++)
+				for (size_t i = 0; i < COUNT; i++)
+					mv[i] = generic_mul(mvp, v[i]);
+			sink = sink + mv[COUNT - 1](3, 0);
+		}));
+
+	report("vec4 dot",
+		time_ns(ops, [&] {
+			float sum = 0.f;
+			for (unsigned pass = 0; pass < PASSES; pass++)
+				for (size_t i = 0; i < COUNT; i++)
+					sum += p[i].dot(p[COUNT - 1 - i]);
+			sink = sink + sum;
+		}),
+		time_ns(ops, [&] {
+			float sum = 0.f;
+			for (unsigned pass = 0; pass < PASSES; pass++)
+				for (size_t i = 0; i < COUNT; i++)
+					sum += generic_dot(p[i], p[COUNT - 1 - i]);
+			sink = sink + sum;
+		}));
+
+	return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef BENCH_BENCH_H_
+#define BENCH_BENCH_H_
+
+/* Micro-benchmarks of the math hot paths
+ *
+ * Every benchmark times an operation of vector.h / matrix.h specialized for
+ * the instruction set of the build (see simd.h) and the generic scalar loop
+ * it replaces, on the same data. Build with SIMD_FORCE_SCALAR to time the
+ * portable fallback of the library instead.
+ */
+namespace bench {
+
+/** Run the benchmarks, print time per operation to stdout
+ *
+ * @return 0 on success.
+ */
+int run(void);
+
+} /* namespace bench */
+
+#endif /* BENCH_BENCH_H_ */
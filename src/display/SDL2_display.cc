@@ -1,9 +1,14 @@
 #include "display.h"
+#include <algorithm>
+#include <cstring>
 #include <format>
 #include <vector>
 #include <SDL.h>
+#include <jobs/jobs.h>
+#include <profile/profile.h>
 
 static bool init_done;
+static bool headless_mode;
 
 static SDL_Window *window;
 static SDL_Renderer *renderer;
@@ -13,11 +18,24 @@ static unsigned width;
 static unsigned height;
 
 static std::vector<uint32_t> framebuffer;
+/* the frame shown by update() in headless mode */
+static std::vector<uint32_t> presented;
 
-int display::init(int w, int h)
+int display::init(int w, int h, bool headless)
 {
 	if (w <= 0 || h <= 0)
 		return 1;
+
+	if (headless) {
+		framebuffer.resize(tile_size(w, h));
+		presented.assign(framebuffer.size(), 0);
+		width = w;
+		height = h;
+		headless_mode = true;
+		init_done = true;
+		return 0;
+	}
+
 	auto wnd_name = std::format("soft_render {}x{}", w, h);
 
 	if (SDL_Init(SDL_INIT_VIDEO))
@@ -29,7 +47,7 @@ int display::init(int w, int h)
 	if (!(canvas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, w, h)))
 		goto destroy_rend;
 
-	framebuffer.resize(w * h);
+	framebuffer.resize(tile_size(w, h));
 	width = w;
 	height = h;
 	init_done = true;
@@ -62,10 +80,14 @@ void display::release(void)
 		SDL_DestroyWindow(window);
 		window = nullptr;
 	}
-	SDL_Quit();
+	if (!headless_mode)
+		SDL_Quit();
 
 	framebuffer.resize(0);
+	presented.resize(0);
+	presented.shrink_to_fit();
 	width = height = 0;
+	headless_mode = false;
 	init_done = false;
 }
 
@@ -80,7 +102,17 @@ void display::put(int x, int y, uint32_t color)
 	if (x < 0 || y < 0 || (unsigned)x >= width || (unsigned)y >= height)
 		return;
 
-	framebuffer[(size_t)y * width + x] = (uint32_t)0xFF000000 | color;
+	get_surface().put(x, y, color);
+}
+
+display::surface_t display::get_surface(void)
+{
+	return { framebuffer.data(), (int)width, (int)height };
+}
+
+display::surface_t display::get_presented(void)
+{
+	return { presented.empty() ? nullptr : presented.data(), (int)width, (int)height };
 }
 
 std::tuple<int, int> display::get_resolution(void)
@@ -90,18 +122,31 @@ std::tuple<int, int> display::get_resolution(void)
 
 int display::update(void)
 {
+	PROFILE_ZONE("display::update");
 	void *pixels;
 	int pitch;
 
+	if (headless_mode) {
+		/* pixels copied by a job */
+		constexpr size_t COPY_GRAIN = 1 << 16;
+
+		jobs::parallel_for(framebuffer.size(), COPY_GRAIN, [](size_t begin, size_t end) {
+			std::copy(framebuffer.begin() + begin, framebuffer.begin() + end, presented.begin() + begin);
+		});
+		return 0;
+	}
 	if (SDL_LockTexture(canvas, nullptr, &pixels, &pitch))
 		return 1;
 
-	uint32_t *src = framebuffer.data();
-	for (size_t row = 0; row < height; row++) {
-		void *dst = (void *)((uintptr_t)pixels + row * pitch);
-		memcpy(dst, src, sizeof(uint32_t) * width);
-		src += width;
-	}
+	/* rows copied by a job */
+	constexpr size_t GRAIN = 64;
+
+	/* the frame buffer is tiled, the texture is linear */
+	const surface_t fb = get_surface();
+	jobs::parallel_for(height, GRAIN, [&fb, pixels, pitch](size_t begin, size_t end) {
+		for (size_t row = begin; row < end; row++)
+			fb.read_row((int)row, (uint32_t *)((uintptr_t)pixels + row * pitch));
+	});
 
 	SDL_UnlockTexture(canvas);
 
@@ -114,7 +159,7 @@ int display::update(void)
 
 int display::get_msg(Message& m)
 {
-	if (!init_done)
+	if (!init_done || headless_mode)
 		return 0;
 
 	SDL_Event evt;
@@ -146,8 +191,42 @@ int display::get_msg(Message& m)
 			m.type = Message::type::MOVE_RIGHT;
 			return 1;
 		}
+		if (evt.key.keysym.sym == SDLK_w) {
+			m.type = Message::type::TOGGLE_WIREFRAME;
+			return 1;
+		}
+		if (evt.key.keysym.sym == SDLK_m) {
+			m.type = Message::type::TOGGLE_MSAA;
+			return 1;
+		}
+		if (evt.key.keysym.sym == SDLK_p) {
+			m.type = Message::type::TOGGLE_PIPELINING;
+			return 1;
+		}
+		if (evt.key.keysym.sym == SDLK_r) {
+			m.type = Message::type::TOGGLE_ROTATION;
+			return 1;
+		}
+		if (evt.key.keysym.sym == SDLK_s) {
+			m.type = Message::type::TOGGLE_SHADOWS;
+			return 1;
+		}
+		if (evt.key.keysym.sym == SDLK_g) {
+			m.type = Message::type::TOGGLE_LIGHTING_MODE;
+			return 1;
+		}
 		break;
 	}
 
 	return 0;
 }
+
+int display::wait_msg(int timeout_ms)
+{
+	if (!init_done || headless_mode)
+		return 0;
+
+	if (timeout_ms < 0)
+		return SDL_WaitEvent(nullptr);
+	return SDL_WaitEventTimeout(nullptr, timeout_ms);
+}
@@ -1,7 +1,9 @@
 #ifndef DISPLAY_H_
 #define DISPLAY_H_
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <tuple>
 #include <message_queue.h>
 
@@ -11,12 +13,15 @@ namespace display {
  *
  * @param w: display width
  * @param h: display height
+ * @param headless: don't open a window. Frames are drawn to the frame buffer
+ * in memory only, update() copies it for get_presented() and no events are
+ * posted.
  * @return 0 on success.
  * 
  * @note The function should be called before any other in this module.
  */
 /* TODO: return std::errc. std::errc() on success */
-int init(int w = 600, int h = 600);
+int init(int w = 600, int h = 600, bool headless = false);
 
 /** Release display resources.
  *
@@ -47,6 +52,128 @@ int update(void);
  */
 void put(int x, int y, uint32_t color);
 
+/* Frame buffer layout
+ * Pixels are stored in TILE x TILE tiles, so a small triangle touches a few
+ * cache lines rather than a line per row. Tiles are in row-major order, so
+ * are pixels of a tile. A surface is padded to whole tiles. The offset of a
+ * pixel is the sum of offsets of its row and its column:
+ * tile_row(y, width) + tile_column(x).
+ */
+constexpr int TILE_SHIFT = 3;
+constexpr int TILE = 1 << TILE_SHIFT;
+
+/** Round a size up to whole tiles */
+constexpr int tile_align(int n)
+{
+	return (n + TILE - 1) & ~(TILE - 1);
+}
+
+/** Get number of pixels of a w x h surface with padding */
+constexpr size_t tile_size(int w, int h)
+{
+	return (size_t)tile_align(w) * tile_align(h);
+}
+
+/** Get offset of row y of a surface width pixels wide */
+constexpr size_t tile_row(int y, int width)
+{
+	return (size_t)(y & ~(TILE - 1)) * tile_align(width) + (size_t)(y & (TILE - 1)) * TILE;
+}
+
+/** Get offset of column x within a row */
+constexpr size_t tile_column(int x)
+{
+	return (size_t)(x & ~(TILE - 1)) * TILE + (size_t)(x & (TILE - 1));
+}
+
+/** Direct frame buffer access
+ * The fast path for rasterizers: no bounds checks and no function calls per
+ * pixel. Callers clip coordinates to [0, width) x [0, height) themselves.
+ * Pixels are tiled, see TILE.
+ */
+struct surface_t {
+	uint32_t *pixels; /**< colors in ARGB8888 format */
+	int width;
+	int height;
+
+	/** Get a pixel. x, y must be within the surface */
+	uint32_t& at(int x, int y) const
+	{
+		return row(y)[tile_column(x)];
+	}
+
+	/** Draw a point. x, y must be within the surface */
+	void put(int x, int y, uint32_t color) const
+	{
+		at(x, y) = (uint32_t)0xFF000000 | color;
+	}
+
+	/** Get a pointer to a row. Pixel x of the row is row(y)[tile_column(x)].
+	 * y must be within the surface
+	 */
+	uint32_t *row(int y) const
+	{
+		return pixels + tile_row(y, width);
+	}
+
+	/** Fill n pixels of a row starting from x. The span must be within the
+	 * surface
+	 */
+	void fill_span(int x, int y, int n, uint32_t color) const
+	{
+		uint32_t *p = row(y);
+		color |= (uint32_t)0xFF000000;
+		for (int i = x; i < x + n; i++)
+			p[tile_column(i)] = color;
+	}
+
+	/** Write n pixels of a row starting from x. Only pixels with non-zero mask
+	 * are written. The span must be within the surface
+	 */
+	void put_span(int x, int y, int n, const uint32_t *colors, const bool *mask) const
+	{
+		uint32_t *p = row(y);
+		for (int i = 0; i < n; i++) {
+			if (mask[i])
+				p[tile_column(x + i)] = (uint32_t)0xFF000000 | colors[i];
+		}
+	}
+
+	/** Fill a rectangle. The rectangle must be within the surface */
+	void fill(int x, int y, int w, int h, uint32_t color) const
+	{
+		for (int r = y; r < y + h; r++)
+			fill_span(x, r, w, color);
+	}
+
+	/** Copy a row to a linear array of width pixels. y must be within the
+	 * surface
+	 */
+	void read_row(int y, uint32_t *dst) const
+	{
+		const uint32_t *p = row(y);
+		int x = 0;
+
+		/* whole tiles are copied by a constant size, inlined */
+		for (; x + TILE <= width; x += TILE)
+			std::memcpy(dst + x, p + tile_column(x), sizeof(uint32_t) * TILE);
+		if (x < width)
+			std::memcpy(dst + x, p + tile_column(x), sizeof(uint32_t) * (width - x));
+	}
+};
+
+/** Get frame buffer surface
+ * The surface is valid until release() or next init() call.
+ */
+surface_t get_surface(void);
+
+/** Get the frame shown by the last update()
+ * A headless display keeps a copy of the frame buffer, so a frame can be read
+ * back while the next one is drawn. A window keeps none, pixels are nullptr.
+ * The surface is valid until release() or next init() call.
+ */
+surface_t get_presented(void);
+
 /** Get screen resolution
  *
  * @return tuple: {width, height}
@@ -64,6 +191,18 @@ std::tuple<int, int> get_resolution(void);
  */
 int get_msg(Message& m);
 
+/** Wait for an event from display
+ * Sleep until an event is posted or the timeout expires. The event is left in
+ * queue for get_msg().
+ *
+ * @param timeout_ms: time to wait in milliseconds, negative value to wait
+ * forever
+ * @return 1 if there is a pending event or 0 on timeout.
+ *
+ * @note The function returns 0 at once if module is not initialized.
+ */
+int wait_msg(int timeout_ms = -1);
+
 } /* namespace display */
 
 #endif /* DISPLAY_H_ */
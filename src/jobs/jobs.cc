@@ -0,0 +1,390 @@
+#include "jobs.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/* Maximum number of jobs depending on a single job */
+constexpr unsigned MAX_CONTINUATIONS = 8;
+
+struct jobs::job_t {
+	job_fn fn;
+	const void *ctx;
+	size_t begin;
+	size_t end;
+	job_t *parent;
+
+	/* the job itself and its unfinished children */
+	std::atomic<int> unfinished;
+	/* submit() and unfinished dependencies */
+	std::atomic<int> pending;
+	/* set when the job, its children and continuations are handled */
+	std::atomic<bool> done{ true };
+
+	/* protects finished and continuations */
+	std::mutex lock;
+	bool finished;
+	unsigned continuation_count;
+	job_t *continuations[MAX_CONTINUATIONS];
+};
+
+namespace {
+
+/* Double ended queue of jobs in a ring buffer. The buffer grows when full and
+ * never shrinks, so queueing doesn't allocate once the pool is warmed up
+ */
+struct queue_t {
+	std::vector<jobs::job_t *> buf;
+	size_t head = 0;
+	size_t count = 0;
+
+	bool empty(void) const
+	{
+		return count == 0;
+	}
+
+	void push_back(jobs::job_t *job)
+	{
+		if (count == buf.size())
+			grow();
+		buf[(head + count++) & (buf.size() - 1)] = job;
+	}
+
+	jobs::job_t *pop_back(void)
+	{
+		return buf[(head + --count) & (buf.size() - 1)];
+	}
+
+	jobs::job_t *pop_front(void)
+	{
+		jobs::job_t *job = buf[head];
+		head = (head + 1) & (buf.size() - 1);
+		count--;
+		return job;
+	}
+
+	void grow(void)
+	{
+		std::vector<jobs::job_t *> b(std::max<size_t>(64, buf.size() * 2));
+		for (size_t i = 0; i < count; i++)
+			b[i] = buf[(head + i) & (buf.size() - 1)];
+		buf.swap(b);
+		head = 0;
+	}
+};
+
+struct worker_t {
+	std::mutex lock;
+	queue_t queue;
+
+	/* jobs created by the thread */
+	std::unique_ptr<jobs::job_t[]> ring{ new jobs::job_t[jobs::JOBS_PER_THREAD] };
+	size_t next_job = 0;
+
+	std::thread thread;
+
+	std::atomic<uint64_t> jobs{ 0 };
+	std::atomic<uint64_t> steals{ 0 };
+	std::atomic<uint64_t> busy_ns{ 0 };
+};
+
+} /* namespace */
+
+/* self of threads outside of the pool */
+constexpr unsigned FOREIGN = ~0u;
+
+static std::vector<std::unique_ptr<worker_t>> workers;
+/* index of the current thread in workers, the main thread is 0 */
+static thread_local unsigned self = FOREIGN;
+/* jobs being executed by the current thread, nested ones run while waiting */
+static thread_local unsigned depth;
+
+static std::atomic<bool> quit;
+/* number of jobs in all queues */
+static std::atomic<int> queued;
+/* idle workers sleep on wakeup */
+static std::atomic<int> sleeping;
+static std::mutex sleep_lock;
+static std::condition_variable wakeup;
+
+static std::chrono::steady_clock::time_point stats_start;
+
+static void push(jobs::job_t *job)
+{
+	worker_t& w = *workers[self];
+	{
+		std::lock_guard<std::mutex> g(w.lock);
+		w.queue.push_back(job);
+	}
+
+	queued.fetch_add(1);
+	if (sleeping.load() > 0) {
+		std::lock_guard<std::mutex> g(sleep_lock);
+		wakeup.notify_one();
+	}
+}
+
+/* Take the newest job of the own queue or steal the oldest one of another */
+static jobs::job_t *pop(void)
+{
+	/* a foreign thread has no queue and doesn't steal: it may only wait */
+	if (self == FOREIGN)
+		return nullptr;
+
+	worker_t& w = *workers[self];
+	jobs::job_t *job;
+
+	{
+		std::lock_guard<std::mutex> g(w.lock);
+		if (!w.queue.empty()) {
+			job = w.queue.pop_back();
+			queued.fetch_sub(1);
+			return job;
+		}
+	}
+
+	for (size_t i = 1; i < workers.size() && queued.load() > 0; i++) {
+		worker_t& victim = *workers[(self + i) % workers.size()];
+		std::lock_guard<std::mutex> g(victim.lock);
+		if (!victim.queue.empty()) {
+			job = victim.queue.pop_front();
+			queued.fetch_sub(1);
+			w.steals.fetch_add(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+static void finish(jobs::job_t *job)
+{
+	if (job->unfinished.fetch_sub(1) != 1)
+		return;
+
+	jobs::job_t *continuations[MAX_CONTINUATIONS];
+	jobs::job_t *parent = job->parent;
+	unsigned n;
+	{
+		std::lock_guard<std::mutex> g(job->lock);
+		job->finished = true;
+		n = job->continuation_count;
+		std::copy(job->continuations, job->continuations + n, continuations);
+	}
+
+	/* the job may be reused by create() as soon as it's done, so it's set
+	 * before the parent can finish and isn't touched after that
+	 */
+	job->done.store(true, std::memory_order_release);
+
+	for (unsigned i = 0; i < n; i++) {
+		if (continuations[i]->pending.fetch_sub(1) == 1)
+			push(continuations[i]);
+	}
+	if (parent)
+		finish(parent);
+}
+
+static void execute(jobs::job_t *job)
+{
+	using namespace std::chrono;
+	worker_t& w = *workers[self];
+	auto start = steady_clock::now();
+
+	depth++;
+	job->fn(job->ctx, job->begin, job->end);
+	depth--;
+
+	/* the time of nested jobs is in the one of the outermost one already */
+	if (!depth) {
+		auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - start);
+		w.busy_ns.fetch_add(elapsed.count(), std::memory_order_relaxed);
+	}
+	w.jobs.fetch_add(1, std::memory_order_relaxed);
+
+	finish(job);
+}
+
+static void worker_main(unsigned index)
+{
+	/* spin a little before going to sleep: jobs come in bursts */
+	constexpr int SPIN = 64;
+
+	self = index;
+	while (!quit.load()) {
+		jobs::job_t *job = nullptr;
+		for (int i = 0; i < SPIN && !job; i++) {
+			if (!(job = pop()))
+				std::this_thread::yield();
+		}
+		if (job) {
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lk(sleep_lock);
+		sleeping.fetch_add(1);
+		wakeup.wait(lk, [] { return queued.load() > 0 || quit.load(); });
+		sleeping.fetch_sub(1);
+	}
+}
+
+/* Take a free job of the ring. Jobs still in flight are skipped, e.g. a
+ * parent waiting for its children. If all of them are, queued jobs are
+ * executed until one is finished.
+ */
+static jobs::job_t *alloc_job(worker_t& w)
+{
+	for (;;) {
+		for (size_t i = 0; i < jobs::JOBS_PER_THREAD; i++) {
+			jobs::job_t *job = &w.ring[w.next_job++ % jobs::JOBS_PER_THREAD];
+			if (job->done.load(std::memory_order_acquire))
+				return job;
+		}
+
+		if (jobs::job_t *job = pop())
+			execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+int jobs::init(unsigned threads)
+{
+	release();
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	workers.clear();
+	for (unsigned i = 0; i < threads; i++)
+		workers.push_back(std::make_unique<worker_t>());
+
+	self = 0;
+	for (unsigned i = 1; i < threads; i++)
+		workers[i]->thread = std::thread(worker_main, i);
+
+	reset_stats();
+	return 0;
+}
+
+void jobs::release(void)
+{
+	{
+		std::lock_guard<std::mutex> g(sleep_lock);
+		quit.store(true);
+		wakeup.notify_all();
+	}
+	for (auto& w : workers) {
+		if (w->thread.joinable())
+			w->thread.join();
+	}
+
+	workers.clear();
+	quit.store(false);
+}
+
+unsigned jobs::get_thread_count(void)
+{
+	return workers.empty() ? 1 : (unsigned)workers.size();
+}
+
+unsigned jobs::get_thread_index(void)
+{
+	/* single threaded mode without init() */
+	if (workers.empty())
+		return 0;
+	return self;
+}
+
+bool jobs::is_pool_thread(void)
+{
+	return workers.empty() || self != FOREIGN;
+}
+
+jobs::job_t *jobs::create(job_fn fn, const void *ctx, size_t begin, size_t end, job_t *parent)
+{
+	/* single threaded mode without init(): the calling thread is the pool */
+	if (workers.empty()) {
+		workers.push_back(std::make_unique<worker_t>());
+		self = 0;
+	}
+
+	if (self == FOREIGN) {
+		std::cerr << "jobs::create() called by a thread outside of the pool\n";
+		std::abort();
+	}
+
+	job_t *job = alloc_job(*workers[self]);
+
+	job->fn = fn;
+	job->ctx = ctx;
+	job->begin = begin;
+	job->end = end;
+	job->parent = parent;
+	job->unfinished.store(1);
+	job->pending.store(1);
+	job->finished = false;
+	job->continuation_count = 0;
+	job->done.store(false);
+
+	if (parent)
+		parent->unfinished.fetch_add(1);
+	return job;
+}
+
+void jobs::depend(job_t *job, job_t *on)
+{
+	std::lock_guard<std::mutex> g(on->lock);
+	if (on->finished)
+		return;
+
+	assert(on->continuation_count < MAX_CONTINUATIONS);
+	job->pending.fetch_add(1);
+	on->continuations[on->continuation_count++] = job;
+}
+
+void jobs::submit(job_t *job)
+{
+	if (job->pending.fetch_sub(1) == 1)
+		push(job);
+}
+
+void jobs::wait(job_t *job)
+{
+	while (!job->done.load(std::memory_order_acquire)) {
+		if (job_t *j = pop())
+			execute(j);
+		else
+			std::this_thread::yield();
+	}
+}
+
+std::vector<jobs::worker_stats_t> jobs::get_stats(void)
+{
+	using namespace std::chrono;
+	auto wall = duration_cast<nanoseconds>(steady_clock::now() - stats_start).count();
+	std::vector<worker_stats_t> stats;
+
+	for (auto& w : workers) {
+		stats.push_back({ w->jobs.load(), w->steals.load(),
+			wall > 0 ? (float)((double)w->busy_ns.load() / (double)wall) : 0.f });
+	}
+	return stats;
+}
+
+void jobs::reset_stats(void)
+{
+	for (auto& w : workers) {
+		w->jobs.store(0);
+		w->steals.store(0);
+		w->busy_ns.store(0);
+	}
+	stats_start = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,134 @@
+#ifndef JOBS_JOBS_H_
+#define JOBS_JOBS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Work stealing job system
+ *
+ * Every thread of the pool owns a deque of jobs. A thread pushes and pops its
+ * own jobs at the back (the most recent job is the hottest in cache) and
+ * steals from the front of other deques when its own one is empty. The thread
+ * which called init() is a member of the pool too: it executes jobs while it
+ * waits for them.
+ *
+ * A job may have a parent: the parent isn't finished until all its children
+ * are. A job may depend on other jobs: it's queued once all of them are
+ * finished. Jobs are created by the thread which called init() or by jobs
+ * themselves. Other threads (e.g. asset loaders) may only wait for jobs,
+ * parallel_for() runs inline on them.
+ */
+namespace jobs {
+
+/** Start worker threads
+ *
+ * @param threads: number of threads executing jobs including the calling
+ * one. 0 - one per hardware thread.
+ * @return 0 on success.
+ *
+ * @note Without init() (or with 1 thread) jobs are executed by wait() on the
+ * calling thread.
+ */
+int init(unsigned threads = 0);
+
+/** Stop worker threads.
+ * Jobs must be finished before the call.
+ *
+ * @note It's safe to invoke the function if init() failed or has never been
+ * invoked.
+ */
+void release(void);
+
+/** Get number of threads executing jobs including the main one */
+unsigned get_thread_count(void);
+
+/** Get index of the calling thread in [0, get_thread_count()). The thread
+ * which called init() is 0. Undefined for threads outside of the pool.
+ */
+unsigned get_thread_index(void);
+
+/** Check if the calling thread is the one which called init() or a worker.
+ * Only these threads may create jobs, create() aborts on other ones.
+ */
+bool is_pool_thread(void);
+
+struct job_t;
+
+/** Job function: ctx, begin, end are passed to create() as is */
+using job_fn = void (*)(const void *ctx, size_t begin, size_t end);
+
+/** Create a job. The job isn't executed until submit()
+ * A job handle is valid until the job is finished and wait() for it returns.
+ * Each thread has a ring of jobs, so up to JOBS_PER_THREAD jobs created by a
+ * thread may be in flight. Beyond that create() executes queued jobs until
+ * one of them is finished.
+ *
+ * @param fn: job function.
+ * @param ctx, begin, end: arguments to pass to fn.
+ * @param parent: a job to finish after this one or nullptr.
+ */
+job_t *create(job_fn fn, const void *ctx, size_t begin = 0, size_t end = 0, job_t *parent = nullptr);
+
+constexpr size_t JOBS_PER_THREAD = 4096;
+
+/** Don't start a job until another one is finished
+ * Must be called before submit(job).
+ *
+ * @param job: a job to defer.
+ * @param on: a job to wait for.
+ */
+void depend(job_t *job, job_t *on);
+
+/** Queue a job for execution. The job is queued on the calling thread */
+void submit(job_t *job);
+
+/** Execute jobs until a job and all its children are finished */
+void wait(job_t *job);
+
+/** Create a job calling f(). f must outlive the job */
+template <typename F>
+job_t *create(const F& f, job_t *parent = nullptr)
+{
+	auto fn = [](const void *ctx, size_t, size_t) { (*static_cast<const F *>(ctx))(); };
+	return create(fn, &f, 0, 0, parent);
+}
+
+/** Split [0, n) into ranges of grain elements and call f(begin, end) for
+ * each of them in parallel. Return when all the ranges are done.
+ */
+template <typename F>
+void parallel_for(size_t n, size_t grain, const F& f)
+{
+	if (grain == 0)
+		grain = 1;
+	if (n <= grain || get_thread_count() < 2 || !is_pool_thread()) {
+		if (n)
+			f((size_t)0, n);
+		return;
+	}
+
+	auto fn = [](const void *ctx, size_t begin, size_t end) {
+		(*static_cast<const F *>(ctx))(begin, end);
+	};
+	job_t *root = create(static_cast<job_fn>([](const void *, size_t, size_t) {}), nullptr);
+	for (size_t begin = 0; begin < n; begin += grain)
+		submit(create(fn, &f, begin, begin + grain < n ? begin + grain : n, root));
+	submit(root);
+	wait(root);
+}
+
+/** Per thread statistics since the last reset_stats() call */
+struct worker_stats_t {
+	uint64_t jobs;   /**< jobs executed */
+	uint64_t steals; /**< jobs stolen from other threads */
+	float busy;      /**< fraction of time spent executing jobs */
+};
+
+/** Get statistics of all threads. The first one is the main thread. */
+std::vector<worker_stats_t> get_stats(void);
+void reset_stats(void);
+
+} /* namespace jobs */
+
+#endif /* JOBS_JOBS_H_ */
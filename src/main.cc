@@ -1,13 +1,271 @@
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
 #include <iostream>
+#include <memory>
 #include <numbers>
+#include <vector>
+#include "assets/assets.h"
+#include "batch/batch.h"
+#include "bench/bench.h"
 #include "display/display.h"
+#include "jobs/jobs.h"
 #include "matrix.h"
+#include "memory/memory.h"
 #include "message_queue.h"
 #include "model/model.h"
+#include "model/stream.h"
+#include "pacing/pacing.h"
+#include "profile/profile.h"
 #include "render/render.h"
+#include "textures/textures.h"
+#include "verify/verify.h"
 
-int main(void)
+static const char *model_file = "data/african_head.obj";
+static const char *texture_file = "data/african_head_diffuse.tga";
+
+/* coordinate axes */
+static const std::vector<vec3f_t> axes_vertices{
+	{ -2.f, 0.f, 0.f }, { 2.f, 0.f, 0.f },
+	{ 0.f, -2.f, 0.f }, { 0.f, 2.f, 0.f },
+	{ 0.f, 0.f, -4.f }, { 0.f, 0.f, 4.f },
+};
+static const std::vector<unsigned> x_axis{ 0, 1 };
+static const std::vector<unsigned> y_axis{ 2, 3 };
+static const std::vector<unsigned> z_axis{ 4, 5 };
+
+static void draw_scene(const model_t& obj, const vec3f_t& pos, float angle, bool wireframe)
+{
+	render::model_mat::identity();
+	render::line(axes_vertices, x_axis, 0xFF0000);
+	render::line(axes_vertices, y_axis, 0x00FF00);
+	render::line(axes_vertices, z_axis, 0x0000FF);
+
+	render::model_mat::translate(pos.x, pos.y, pos.z);
+	render::model_mat::rotate(angle, 0.f, 1.f, 0.f);
+	render::shadow_triangle(obj.faces_, obj.vertices_);
+	render::triangle(obj);
+	if (wireframe) {
+		/* overlay: don't hide edges behind the model itself */
+		render::zbuf_enable(false);
+		render::wireframe(obj.faces_, obj.vertices_, 0xFFFF00);
+		render::zbuf_enable(true);
+	}
+}
+
+/* Render a turn of the model offline.
+ * output: "-" or *.y4m for a YUV4MPEG2 stream, a prefix of numbered PPM images
+ * otherwise.
+ */
+static int render_turntable(const model_t& obj, unsigned frames, const char *output)
+{
+	size_t len = std::strlen(output);
+	bool y4m = !std::strcmp(output, "-") || (len > 4 && !std::strcmp(output + len - 4, ".y4m"));
+	batch::stats_t stats;
+
+	int ret = batch::run(frames, y4m ? batch::format::y4m : batch::format::ppm, output, 60,
+		[&obj, frames](unsigned frame) {
+			float angle = 2 * std::numbers::pi_v<float> * frame / frames;
+			draw_scene(obj, { 0.f, 0.f, 0.f }, angle, false);
+		}, &stats);
+	if (ret) {
+		std::cerr << "Batch rendering failed\n";
+		return ret;
+	}
+
+	std::cerr << stats.frames << " frames in " << stats.seconds << " s: "
+		<< stats.fps << " frames/s, " << jobs::get_thread_count() << " threads\n";
+	return 0;
+}
+
+/* Print texture cache statistics since the last report */
+static void report_textures(void)
+{
+	auto stats = textures::get_stats();
+	uint64_t requests = stats.hits + stats.misses;
+
+	if (requests) {
+		std::cout << "textures: " << 100.f * stats.hits / requests << "% hits, "
+			<< stats.misses << " misses, " << stats.evictions << " evictions, "
+			<< (stats.resident >> 10) << " of " << (stats.budget >> 10) << " KiB resident\n";
+	}
+	textures::reset_stats();
+}
+
+/* Light and shadows of the scene */
+static void setup_scene(void)
+{
+	/* light from the upper left, the shadow map covers the model */
+	render::set_light_direction({ -1.f, 1.f, 1.f });
+	render::set_shadow_bounds({ 0.f, 0.f, 0.f }, 1.25f);
+	if (render::shadow_enable(true))
+		std::cerr << "Failed to enable shadows\n";
+}
+
+/* Poses of the equivalence suite: the model turned, closer to the camera and
+ * partially off-screen
+ */
+static const struct {
+	vec3f_t pos;
+	float angle;
+} verify_poses[] = {
+	{ { 0.f, 0.f, 0.f }, 0.f },
+	{ { 0.f, 0.f, 0.f }, 2.3f },
+	{ { 0.4f, -0.3f, 1.f }, 4.f },
+	{ { -1.3f, 0.5f, -1.f }, 0.9f },
+};
+
+/* Check that optimized rendering paths draw the same image as the reference
+ * one, in modes of the reference too, and the reference to baseline images
+ */
+static int verify_paths(const model_t& obj, const char *output, verify::baseline_t baseline)
+{
+	model_t optimized = obj;
+	optimized.optimize();
+
+	/* Vertices snapped to 1/256 pixel move edges: a pixel on an edge may
+	 * change its triangle. Without culling a back face may win a depth tie
+	 * on the silhouette.
+	 */
+	constexpr verify::tolerance_t EDGES = { 0, 0.005f };
+	constexpr verify::tolerance_t SILHOUETTE = { 0, 0.0001f };
+	/* Upscaled from 0.75 of the resolution a pixel covers 1.8 pixels */
+	constexpr verify::tolerance_t SCALED_EDGES = { 0, 0.01f };
+	/* A coarser mip level averages texels: detail of the texture is lost,
+	 * but the color is close. Some pixels at high contrast texture edges
+	 * differ more.
+	 */
+	constexpr verify::tolerance_t MIPMAPS = { 32, 0.005f };
+	/* Builds for other instruction sets sum transformations in another
+	 * order: a vertex may move by a rounding error.
+	 */
+	baseline.tolerance = { 0, 0.0001f };
+
+	void (*msaa)(void) = [] { render::msaa_enable(true); };
+	/* an internal buffer upscaled to the display, as with dynamic resolution */
+	void (*scaled)(void) = [] { render::set_resolution_scale(0.75f); };
+	void (*per_vertex)(void) = [] { render::set_lighting_mode(render::lighting_mode::per_vertex); };
+	void (*threads)(void) = [] {
+		jobs::release();
+		jobs::init(4);
+		render::pipelining_enable(true);
+	};
+	/* sampling level 0 the quad shader matches the per pixel one */
+	void (*quad_shader)(void) = [] {
+		render::mipmapping_enable(true);
+		render::set_lod_bias(-(float)render::mip_chain_t::MAX_LEVELS);
+	};
+
+	verify::suite_t suite{
+		{ { 600, 600 }, { 317, 239 }, { 1280, 720 } },
+		(unsigned)std::size(verify_poses),
+		[](const void *) {
+			/* the reference: a single thread, float rasterizer, frames
+			 * aren't pipelined, textures are sampled per pixel at the
+			 * level of the model. The frame in flight is finished
+			 * before the jobs it uses go away.
+			 */
+			render::pipelining_enable(false);
+			jobs::release();
+			jobs::init(1);
+			render::set_target_frame_time(0.f);
+			render::set_resolution_scale(1.f);
+			render::fixed_point_enable(false);
+			render::msaa_enable(false);
+			render::mipmapping_enable(false);
+			render::set_lod_bias(0.f);
+			render::set_lighting_mode(render::lighting_mode::per_pixel);
+			render::set_cull_mode(render::cull_mode::back);
+			render::set_depth_format(render::zbuf::format::float32);
+			render::set_depth_range(1.f, 10.f);
+			render::lookat({ 0.f, 0.f, 3.f }, { 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f });
+			setup_scene();
+		},
+		[](const void *ctx, unsigned pose) {
+			draw_scene(*static_cast<const model_t *>(ctx), verify_poses[pose].pos, verify_poses[pose].angle, false);
+		},
+		&obj,
+		{
+			{ "fixed_point", [] { render::fixed_point_enable(true); }, EDGES, &obj },
+			{ "pipelining", [] { render::pipelining_enable(true); }, verify::EXACT, &obj },
+			{ "threads", [] { jobs::release(); jobs::init(4); }, verify::EXACT, &obj },
+			{ "quad_shader", quad_shader, verify::EXACT, &obj },
+			{ "mipmapping", [] { render::mipmapping_enable(true); }, MIPMAPS, &obj },
+			{ "msaa_fixed_point", [] { render::fixed_point_enable(true); }, EDGES, &obj, msaa },
+			{ "msaa_threads", threads, verify::EXACT, &obj, msaa },
+			{ "msaa_quad_shader", quad_shader, verify::EXACT, &obj, msaa },
+			{ "scaled_fixed_point", [] { render::fixed_point_enable(true); }, SCALED_EDGES, &obj, scaled },
+			{ "scaled_threads", threads, verify::EXACT, &obj, scaled },
+			{ "per_vertex_fixed_point", [] { render::fixed_point_enable(true); }, EDGES, &obj, per_vertex },
+			{ "per_vertex_threads", threads, verify::EXACT, &obj, per_vertex },
+			{ "no_culling", [] { render::set_cull_mode(render::cull_mode::none); }, SILHOUETTE, &obj },
+			{ "depth_unorm16", [] { render::set_depth_format(render::zbuf::format::unorm16); }, verify::EXACT, &obj },
+			{ "depth_unorm24", [] { render::set_depth_format(render::zbuf::format::unorm24); }, verify::EXACT, &obj },
+			{ "depth_reversed", [] { render::set_depth_format(render::zbuf::format::reversed_float32); }, verify::EXACT, &obj },
+			{ "optimized_model", [] {}, verify::EXACT, &optimized },
+			{ "all", [] {
+				jobs::release();
+				jobs::init(4);
+				render::fixed_point_enable(true);
+				render::pipelining_enable(true);
+				render::set_depth_format(render::zbuf::format::unorm24);
+			}, EDGES, &optimized },
+		},
+	};
+
+	int failed = verify::run(suite, output, baseline);
+	if (failed < 0)
+		return 1;
+
+	std::cout << (failed ? "FAILED: " : "passed, ") << failed << " mismatching images\n";
+	return failed ? 1 : 0;
+}
+
+/* Parse arguments of --verify, return 0 on success */
+static int parse_verify_args(int argc, char **argv, const char *&output, verify::baseline_t& baseline)
+{
+	for (int i = 0; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--baseline") || !std::strcmp(argv[i], "--write-baseline")) {
+			if (i + 1 == argc || baseline.prefix)
+				return 1;
+			baseline.write = argv[i][2] == 'w';
+			baseline.prefix = argv[++i];
+		} else if (!output && argv[i][0] != '-') {
+			output = argv[i];
+		} else {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Print vertex cache efficiency of the model before and after optimization */
+static int report_acmr(void)
+{
+	constexpr unsigned CACHE_SIZES[] = { 8, 16, 32 };
+
+	model_t obj(model_file, texture_file);
+	if (!obj.is_loaded())
+		return 1;
+
+	float before[std::size(CACHE_SIZES)];
+	for (size_t i = 0; i < std::size(CACHE_SIZES); i++)
+		before[i] = obj.get_acmr(CACHE_SIZES[i]);
+
+	auto start = std::chrono::steady_clock::now();
+	obj.optimize();
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::cout << "optimized in " << elapsed.count() << " ms\n";
+	for (size_t i = 0; i < std::size(CACHE_SIZES); i++) {
+		std::cout << "ACMR, FIFO of " << CACHE_SIZES[i] << " vertices: " << before[i]
+			<< " -> " << obj.get_acmr(CACHE_SIZES[i]) << "\n";
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
 {
 	/* display resolution */
 	constexpr int w = 600;
@@ -21,15 +279,126 @@ int main(void)
 	/* model position */
 	vec3f_t pos{ 0.f, 0.f, 0.f };
 
-	render::init(w, h);
+	/* soft_render --acmr: report vertex cache efficiency of the model */
+	if (argc == 2 && !std::strcmp(argv[1], "--acmr"))
+		return report_acmr();
+
+	/* soft_render --bench: time the math hot paths */
+	if (argc == 2 && !std::strcmp(argv[1], "--bench"))
+		return bench::run();
+
+	/* soft_render --verify [<prefix>] [--baseline | --write-baseline <images>]:
+	 * compare optimized rendering paths to the reference one, write diff
+	 * images of mismatches to <prefix>*.ppm. Compare the reference to images
+	 * written by another build or write them.
+	 */
+	const char *verify_output = nullptr;
+	verify::baseline_t baseline;
+	if (argc >= 2 && !std::strcmp(argv[1], "--verify") &&
+			!parse_verify_args(argc - 2, argv + 2, verify_output, baseline)) {
+		assets::init();
+		/* the reference is drawn with the model as it's in the file */
+		auto loading = assets::load_model(model_file, texture_file, false);
+		assets::wait(loading);
+		model_t obj = loading.get();
+		assets::release();
+		if (!obj.is_loaded())
+			return 1;
+
+		int ret = verify_paths(obj, verify_output, baseline);
+		jobs::release();
+		return ret;
+	}
+
+	/* soft_render --batch <frames> <output> [<threads>]: render offline
+	 * without a window
+	 */
+	bool batch_mode = (argc == 4 || argc == 5) && !std::strcmp(argv[1], "--batch");
+	unsigned frames = batch_mode ? (unsigned)std::strtoul(argv[2], nullptr, 10) : 0;
+	unsigned threads = batch_mode && argc == 5 ? (unsigned)std::strtoul(argv[4], nullptr, 10) : 0;
+	int ret = 0;
+
+	/* soft_render --trace <skip> <frames> <output>: run interactively, write
+	 * profiling zones of frames after skip ones as a Chrome trace
+	 */
+	bool trace_mode = argc == 5 && !std::strcmp(argv[1], "--trace");
+	if (trace_mode && profile::capture((unsigned)std::strtoul(argv[2], nullptr, 10),
+		(unsigned)std::strtoul(argv[3], nullptr, 10), argv[4]))
+		trace_mode = false;
+
+	if (argc > 1 && (!batch_mode || !frames) && !trace_mode) {
+		std::cerr << "usage: " << argv[0] << " [--batch <frames> <output> [<threads>] |\n"
+			"--trace <skip> <frames> <output> | --acmr | --bench |\n"
+			"--verify [<prefix>] [--baseline | --write-baseline <images>]]\n"
+			"output: \"-\" or *.y4m for a YUV4MPEG2 stream, a prefix of PPM images otherwise\n"
+			"threads: job threads, one per core by default\n"
+			"--trace: write profiling zones of frames to output in Chrome trace_event JSON\n"
+			"format, skip 0 includes loading\n"
+			"--acmr: report vertex cache miss ratio of the model before and after optimization\n"
+			"--bench: time SIMD math against the generic loops\n"
+			"--verify: compare optimized rendering paths to the reference one, write diff\n"
+			"images of mismatches to <prefix>*.ppm\n"
+			"--baseline: compare images of the reference path to images written by\n"
+			"--write-baseline of another build, e.g. with SIMD_FORCE_SCALAR\n";
+		return 1;
+	}
+
+	bool wireframe = false;
+	bool rotate = true;
+	float angle = 0.f;
+
+	/* draw at 60 fps, rotate the model by a degree per 20 ms tick */
+	pacing::scheduler_t scheduler(60.f, 50.f);
+	auto report_ts = std::chrono::steady_clock::now();
+	uint64_t report_allocs = 0;
+
+	/* the model and its textures are loaded while the renderer starts,
+	 * interactive mode streams the model instead
+	 */
+	std::future<model_t> loading;
+	if (batch_mode) {
+		assets::init();
+		/* reorder faces and vertices for locality, once at load time */
+		loading = assets::load_model(model_file, texture_file, true);
+	}
+
+	/* a thread per core */
+	jobs::init(threads);
+	render::init(w, h, batch_mode);
+	if (!batch_mode) {
+		/* hold 60 fps: lower render resolution of heavy frames */
+		render::set_target_frame_time(16.6f);
+		/* overlap geometry of a frame with rasterization of the previous one */
+		render::pipelining_enable(true);
+	}
 	auto [width, height] = display::get_resolution();
 
-	model_t obj("data/african_head.obj", "data/african_head_diffuse.tga");
-	if (!obj.is_loaded())
-		goto out;
-	
-	render::set_texture(obj.texture_image_, obj.texture_width_, obj.texture_height_);
+	model_t obj;
+	std::unique_ptr<model_stream_t> stream;
+	if (batch_mode) {
+		assets::wait(loading);
+		obj = loading.get();
+		/* nothing else to load: don't keep the loader threads */
+		assets::release();
+		if (!obj.is_loaded()) {
+			ret = 1;
+			goto out;
+		}
+	} else {
+		/* draw right away, the model appears as it's loaded */
+		stream = std::make_unique<model_stream_t>(model_file, texture_file);
+	}
+
 	render::lookat(eye, center, up);
+	setup_scene();
+
+	if (batch_mode) {
+		ret = render_turntable(obj, frames, argv[3]);
+		goto out;
+	}
+
+	/* don't count loading */
+	report_allocs = memory::get_heap_allocs();
 
 	Message m;
 	for (bool quit = false; !quit;) {
@@ -54,35 +423,99 @@ int main(void)
 				pos.x += 1.f;
 				std::cout << "pos: " << pos << "\n";
 				break;
+			case Message::type::TOGGLE_WIREFRAME:
+				wireframe = !wireframe;
+				break;
+			case Message::type::TOGGLE_MSAA:
+				if (render::msaa_enable(!render::is_msaa_enabled()))
+					std::cerr << "Failed to toggle MSAA\n";
+				break;
+			case Message::type::TOGGLE_PIPELINING:
+				render::pipelining_enable(!render::is_pipelining_enabled());
+				break;
+			case Message::type::TOGGLE_ROTATION:
+				rotate = !rotate;
+				break;
+			case Message::type::TOGGLE_SHADOWS:
+				/* off -> hard -> filtered -> off */
+				if (!render::is_shadow_enabled()) {
+					render::shadow_enable(true);
+					render::shadow_pcf_enable(false);
+				} else if (!render::is_shadow_pcf_enabled()) {
+					render::shadow_pcf_enable(true);
+				} else {
+					render::shadow_enable(false);
+				}
+				break;
+			case Message::type::TOGGLE_LIGHTING_MODE:
+				/* Gouraud shading: cheaper, but coarse */
+				if (render::get_lighting_mode() == render::lighting_mode::per_pixel)
+					render::set_lighting_mode(render::lighting_mode::per_vertex);
+				else
+					render::set_lighting_mode(render::lighting_mode::per_pixel);
+				break;
 			}
 		}
 
-		static float angle{ 0.f };
-		{
-			using namespace std::chrono;
-			static auto last_rotation_ts{ steady_clock::now() };
-		
-			auto elapsed = steady_clock::now() - last_rotation_ts;
-			if (elapsed >= 20ms) {
-				angle += std::numbers::pi_v<float> / 180.f;
-				if (angle > 2 * std::numbers::pi_v<float>)
-					angle -= 2 * std::numbers::pi_v<float>;
-				last_rotation_ts = steady_clock::now();
+		for (unsigned ticks = scheduler.begin_frame(); ticks; ticks--) {
+			if (!rotate)
+				continue;
+			angle += std::numbers::pi_v<float> / 180.f;
+			if (angle > 2 * std::numbers::pi_v<float>)
+				angle -= 2 * std::numbers::pi_v<float>;
+		}
+
+		if (stream && stream->is_pending()) {
+			/* the model may be reallocated: wait for the frame in flight */
+			render::flush();
+			auto state = stream->update(obj);
+			if (state == model_stream_t::state::failed) {
+				ret = 1;
+				break;
+			}
+			if (state == model_stream_t::state::loaded) {
+				stream.reset();
+				/* don't count loading */
+				report_allocs = memory::get_heap_allocs();
 			}
 		}
 
 		render::clear();
-		render::model_mat::identity();
-		render::line({ -2.f, 0.f, 0.f }, { 2.f, 0.f, 0.f }, 0xFF0000);
-		render::line({ 0.f, -2.f, 0.f }, { 0.f, 2.f, 0.f }, 0x00FF00);
-		render::line({ 0.f, 0.f, -4.f }, { 0.f, 0.f, 4.f }, 0x0000FF);
-
-		render::model_mat::translate(pos.x, pos.y, pos.z);
-		render::model_mat::rotate(angle, 0.f, 1.f, 0.f);
-		render::triangle(obj.faces_, obj.vertices_, obj.normals_, obj.texture_);
+		draw_scene(obj, pos, angle, wireframe);
 		render::update();
+
+		if (auto now = std::chrono::steady_clock::now(); now - report_ts >= std::chrono::seconds(5)) {
+			auto stats = scheduler.get_stats();
+			uint64_t allocs = memory::get_heap_allocs();
+			if (stats.frames) {
+				std::cout << "frame: " << stats.mean_ms << " ms, jitter: " << stats.jitter_ms
+					<< " ms, max: " << stats.max_ms << " ms, heap allocations: "
+					<< (float)(allocs - report_allocs) / stats.frames << "\n";
+			}
+			report_textures();
+			scheduler.reset_stats();
+			report_ts = now;
+			report_allocs = allocs;
+		}
+
+		/* nothing changes until an event comes: show the last frame and
+		 * sleep. A streamed model changes as it's loaded, keep drawing.
+		 */
+		bool animating = rotate || stream;
+		if (!animating)
+			render::flush();
+		scheduler.end_frame(animating);
 	}
  out:
 	render::release();
-	return 0;
+	assets::release();
+	report_textures();
+
+	auto stats = jobs::get_stats();
+	for (size_t i = 0; i < stats.size(); i++) {
+		std::cerr << "thread " << i << ": " << stats[i].jobs << " jobs, "
+			<< stats[i].steals << " stolen, " << (int)(stats[i].busy * 100.f) << "% busy\n";
+	}
+	jobs::release();
+	return ret;
 }
@@ -1,8 +1,10 @@
 #ifndef MATRIX_H_
 #define MATRIX_H_
 
+#include <cstddef>
 #include <ostream>
 #include <type_traits>
+#include "simd.h"
 
 template<size_t ROWS, size_t COLUMNS, typename T>
 class matrix_t {
@@ -13,6 +15,14 @@ public:
 	{
 	}
 
+	/** Construct a matrix without initializing its elements.
+	 * Used for results which are fully overwritten anyway.
+	 */
+	struct uninitialized_t {};
+	explicit matrix_t(uninitialized_t)
+	{
+	}
+
 	/* TODO: Add nested initializer list constructor */
 	template <typename... RestArgs>
 	matrix_t(T first, RestArgs... rest)
@@ -41,11 +51,14 @@ public:
 	template<size_t RHS_COLUMNS>
 	matrix_t<ROWS, RHS_COLUMNS, T> operator*(const matrix_t<COLUMNS, RHS_COLUMNS, T>& rhs) const
 	{
-		matrix_t<ROWS, RHS_COLUMNS, T> ret;
+		using result_t = matrix_t<ROWS, RHS_COLUMNS, T>;
+		result_t ret{ typename result_t::uninitialized_t{} };
 		for (size_t r = 0; r < ROWS; r++) {
 			for (size_t c = 0; c < RHS_COLUMNS; c++) {
+				T sum = 0;
 				for (size_t i = 0; i < COLUMNS; i++)
-					ret(r, c) += data_[r][i] * rhs(i, c);
+					sum += data_[r][i] * rhs(i, c);
+				ret(r, c) = sum;
 			}
 		}
 		return ret;
@@ -76,6 +89,17 @@ public:
 		return data_[row][column];
 	}
 
+	/** Raw access to the elements stored in row-major order */
+	T *data(void)
+	{
+		return &data_[0][0];
+	}
+
+	const T *data(void) const
+	{
+		return &data_[0][0];
+	}
+
 	matrix_t<ROWS, COLUMNS, T> operator*=(const matrix_t<COLUMNS, COLUMNS, T>& rhs)
 	{
 		auto product = *this * rhs;
@@ -102,5 +126,91 @@ std::ostream& operator<<(std::ostream& ostream, const matrix_t<ROWS, COLUMNS, T>
 
 using mat4x4f_t = matrix_t<4, 4, float>;
 using mat4x1f_t = matrix_t<4, 1, float>;
+using mat3x3f_t = matrix_t<3, 3, float>;
+using mat3x1f_t = matrix_t<3, 1, float>;
+
+/* Vectorized 4x4 single precision products. The scalar build uses the generic
+ * implementation above. Matrices are loaded unaligned: they live on the stack
+ * and inside other structures without any alignment guarantee.
+ */
+#if !defined(SIMD_SCALAR)
+template<> template<>
+inline mat4x4f_t mat4x4f_t::operator*<4>(const mat4x4f_t& rhs) const
+{
+	mat4x4f_t ret{ uninitialized_t{} };
+	const float *b = rhs.data();
+
+#if defined(SIMD_AVX)
+	/* two rows of the result per iteration: the lower lane holds row r, the
+	 * upper lane row r + 1.
+	 */
+	__m256 b0 = _mm256_broadcast_ps((const __m128 *)(b + 0));
+	__m256 b1 = _mm256_broadcast_ps((const __m128 *)(b + 4));
+	__m256 b2 = _mm256_broadcast_ps((const __m128 *)(b + 8));
+	__m256 b3 = _mm256_broadcast_ps((const __m128 *)(b + 12));
+	for (size_t r = 0; r < 4; r += 2) {
+		__m256 a = _mm256_loadu_ps(data_[r]);
+		__m256 row = _mm256_mul_ps(_mm256_permute_ps(a, 0x00), b0);
+		row = _mm256_add_ps(row, _mm256_mul_ps(_mm256_permute_ps(a, 0x55), b1));
+		row = _mm256_add_ps(row, _mm256_mul_ps(_mm256_permute_ps(a, 0xAA), b2));
+		row = _mm256_add_ps(row, _mm256_mul_ps(_mm256_permute_ps(a, 0xFF), b3));
+		_mm256_storeu_ps(ret.data_[r], row);
+	}
+#elif defined(SIMD_SSE)
+	__m128 b0 = _mm_loadu_ps(b + 0);
+	__m128 b1 = _mm_loadu_ps(b + 4);
+	__m128 b2 = _mm_loadu_ps(b + 8);
+	__m128 b3 = _mm_loadu_ps(b + 12);
+	for (size_t r = 0; r < 4; r++) {
+		__m128 row = _mm_mul_ps(_mm_set1_ps(data_[r][0]), b0);
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(data_[r][1]), b1));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(data_[r][2]), b2));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(data_[r][3]), b3));
+		_mm_storeu_ps(ret.data_[r], row);
+	}
+#elif defined(SIMD_NEON)
+	float32x4_t b0 = vld1q_f32(b + 0);
+	float32x4_t b1 = vld1q_f32(b + 4);
+	float32x4_t b2 = vld1q_f32(b + 8);
+	float32x4_t b3 = vld1q_f32(b + 12);
+	for (size_t r = 0; r < 4; r++) {
+		float32x4_t a = vld1q_f32(data_[r]);
+		float32x4_t row = vmulq_laneq_f32(b0, a, 0);
+		row = vfmaq_laneq_f32(row, b1, a, 1);
+		row = vfmaq_laneq_f32(row, b2, a, 2);
+		row = vfmaq_laneq_f32(row, b3, a, 3);
+		vst1q_f32(ret.data_[r], row);
+	}
+#endif
+
+	return ret;
+}
+
+template<> template<>
+inline mat4x1f_t mat4x4f_t::operator*<1>(const mat4x1f_t& rhs) const
+{
+	mat4x1f_t ret{ mat4x1f_t::uninitialized_t{} };
+
+#if defined(SIMD_SSE)
+	__m128 v = _mm_loadu_ps(rhs.data());
+	__m128 r0 = _mm_mul_ps(_mm_loadu_ps(data_[0]), v);
+	__m128 r1 = _mm_mul_ps(_mm_loadu_ps(data_[1]), v);
+	__m128 r2 = _mm_mul_ps(_mm_loadu_ps(data_[2]), v);
+	__m128 r3 = _mm_mul_ps(_mm_loadu_ps(data_[3]), v);
+	/* horizontal sums of four rows at once */
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_storeu_ps(ret.data(), _mm_add_ps(_mm_add_ps(r0, r1), _mm_add_ps(r2, r3)));
+#elif defined(SIMD_NEON)
+	float32x4_t v = vld1q_f32(rhs.data());
+	float32x4_t r0 = vmulq_f32(vld1q_f32(data_[0]), v);
+	float32x4_t r1 = vmulq_f32(vld1q_f32(data_[1]), v);
+	float32x4_t r2 = vmulq_f32(vld1q_f32(data_[2]), v);
+	float32x4_t r3 = vmulq_f32(vld1q_f32(data_[3]), v);
+	vst1q_f32(ret.data(), vpaddq_f32(vpaddq_f32(r0, r1), vpaddq_f32(r2, r3)));
+#endif
+
+	return ret;
+}
+#endif /* !SIMD_SCALAR */
 
 #endif /* MARIX_H_ */
@@ -0,0 +1,108 @@
+#include "memory.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+/* the smallest block taken from the heap */
+static constexpr size_t MIN_BLOCK = 64 * 1024;
+/* merged blocks are rounded up to pages */
+static constexpr size_t PAGE = 4096;
+
+static std::atomic<uint64_t> heap_allocs;
+
+/* Count heap allocations. Array and nothrow versions of operator new call this
+ * one, aligned versions aren't used
+ */
+void *operator new(std::size_t size)
+{
+	heap_allocs.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+uint64_t memory::get_heap_allocs(void)
+{
+	return heap_allocs.load(std::memory_order_relaxed);
+}
+
+static char *align_up(char *p, size_t align)
+{
+	return (char *)(((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1));
+}
+
+memory::arena_t::arena_t(size_t size)
+{
+	if (size)
+		add_block(size);
+}
+
+memory::arena_t::~arena_t()
+{
+	free_blocks();
+}
+
+void memory::arena_t::add_block(size_t size)
+{
+	block_t *b = static_cast<block_t *>(::operator new(sizeof(block_t) + size));
+	b->next = blocks_;
+	b->size = size;
+	blocks_ = b;
+	cur_ = reinterpret_cast<char *>(b + 1);
+	end_ = cur_ + size;
+}
+
+void memory::arena_t::free_blocks(void)
+{
+	while (blocks_) {
+		block_t *next = blocks_->next;
+		::operator delete(blocks_);
+		blocks_ = next;
+	}
+	cur_ = end_ = nullptr;
+}
+
+void *memory::arena_t::alloc(size_t size, size_t align)
+{
+	char *p = align_up(cur_, align);
+
+	/* padding may take p past the end of a block of an unaligned size */
+	if (!blocks_ || p > end_ || size > (size_t)(end_ - p)) {
+		size_t grow = blocks_ ? blocks_->size * 2 : MIN_BLOCK;
+		add_block(std::max(size + align, grow));
+		p = align_up(cur_, align);
+	}
+
+	/* padding counts, so a merged block fits the same allocations */
+	used_ += (size_t)(p - cur_) + size;
+	cur_ = p + size;
+	return p;
+}
+
+void memory::arena_t::reset(void)
+{
+	high_water_ = std::max(high_water_, used_);
+	used_ = 0;
+	if (!blocks_)
+		return;
+
+	if (blocks_->next || blocks_->size < high_water_) {
+		/* a bit more than the high-water mark: padding depends on addresses */
+		size_t size = (high_water_ + high_water_ / 8 + PAGE - 1) / PAGE * PAGE;
+		free_blocks();
+		add_block(size);
+		return;
+	}
+
+	cur_ = reinterpret_cast<char *>(blocks_ + 1);
+}
@@ -0,0 +1,90 @@
+#ifndef MEMORY_MEMORY_H_
+#define MEMORY_MEMORY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace memory {
+
+/** Linear (bump) allocator for transient data
+ * Allocation moves a pointer within a block of memory, all the memory is
+ * freed at once by reset(). If a block runs out, a new one is taken from the
+ * heap. reset() merges blocks to a single one of the high-water size, so once
+ * the arena has seen the largest frame it doesn't touch the heap any more.
+ *
+ * The arena isn't thread safe: use an arena per thread.
+ */
+class arena_t {
+public:
+	/** @param size: initial capacity in bytes, 0 - allocate on demand */
+	explicit arena_t(size_t size = 0);
+	~arena_t();
+
+	arena_t(const arena_t&) = delete;
+	arena_t& operator=(const arena_t&) = delete;
+
+	/** Allocate memory. Throws std::bad_alloc if the heap is out of memory.
+	 *
+	 * @param size: bytes to allocate.
+	 * @param align: power of two alignment.
+	 * @return a pointer valid until reset().
+	 */
+	void *alloc(size_t size, size_t align = alignof(std::max_align_t));
+
+	/** Allocate an array of n default initialized objects. The objects are
+	 * never destroyed, so they must be trivially destructible.
+	 */
+	template <typename T>
+	T *alloc_array(size_t n)
+	{
+		static_assert(std::is_trivially_destructible_v<T>);
+		T *p = static_cast<T *>(alloc(n * sizeof(T), alignof(T)));
+		std::uninitialized_default_construct_n(p, n);
+		return p;
+	}
+
+	/** Construct an object. The caller must destroy it before reset() */
+	template <typename T, typename... A>
+	T *create(A&&... args)
+	{
+		return new (alloc(sizeof(T), alignof(T))) T(std::forward<A>(args)...);
+	}
+
+	/** Free all allocations */
+	void reset(void);
+
+	/** Get bytes allocated since the last reset() */
+	size_t get_used(void) const { return used_; }
+
+	/** Get the most bytes ever allocated between two resets */
+	size_t get_high_water(void) const { return high_water_; }
+
+private:
+	struct block_t {
+		block_t *next;
+		size_t size;
+	};
+
+	void add_block(size_t size);
+	void free_blocks(void);
+
+	/* the current block is the head of the list */
+	block_t *blocks_ = nullptr;
+	char *cur_ = nullptr;
+	char *end_ = nullptr;
+	size_t used_ = 0;
+	size_t high_water_ = 0;
+};
+
+/** Get number of heap allocations (operator new calls) since program start.
+ * Compare values taken a frame apart to check that a frame doesn't allocate.
+ */
+uint64_t get_heap_allocs(void);
+
+} /* namespace memory */
+
+#endif /* MEMORY_MEMORY_H_ */
@@ -8,6 +8,12 @@ struct Message {
 		MOVE_CLOSER,
 		MOVE_LEFT,
 		MOVE_RIGHT,
+		TOGGLE_WIREFRAME,
+		TOGGLE_MSAA,
+		TOGGLE_PIPELINING,
+		TOGGLE_ROTATION,
+		TOGGLE_SHADOWS,
+		TOGGLE_LIGHTING_MODE,
 	} type;
 };
 
@@ -3,14 +3,18 @@
  * on heap using STL containers.
  */
 #include "model.h"
+#include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <charconv>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <system_error>
 #include <vector>
+#include <profile/profile.h>
 
 static void trim(std::string &s)
 {
@@ -92,8 +96,15 @@ static struct model_t::Face parse_faces(std::string_view str)
 	return ret;
 }
 
-/* TODO: malformed files */
 std::errc model_t::load_texture(const char *filename) noexcept
+{
+	texture_id_ = textures::open(filename);
+	return texture_id_ == textures::NONE ? std::errc::no_such_file_or_directory : std::errc();
+}
+
+/* TODO: malformed files */
+std::errc model_t::load_tga(const char *filename, std::vector<uint32_t>& image,
+	size_t& width, size_t& height) noexcept
 {
 	std::ifstream file(filename, std::ifstream::binary);
 	if (!file.is_open()) {
@@ -132,9 +143,9 @@ std::errc model_t::load_texture(const char *filename) noexcept
 	if (tga_hdr.img_desc != 0)
 		return std::errc::function_not_supported;
 
-	texture_width_ = tga_hdr.width;
-	texture_height_ = tga_hdr.height;
-	texture_image_.resize(texture_width_ * texture_height_);
+	width = tga_hdr.width;
+	height = tga_hdr.height;
+	image.resize(width * height);
 
 	file.seekg(tga_hdr.id_len, std::ios_base::cur); /* seek to pixel data */
 
@@ -217,8 +228,8 @@ std::errc model_t::load_texture(const char *filename) noexcept
 	uint32_t color = 0;
 	unsigned cnt;
 
-	for (size_t y = 0; y < texture_width_; y++) {
-		for (size_t x = 0; x < texture_height_; x++) {
+	for (size_t y = 0; y < height; y++) {
+		for (size_t x = 0; x < width; x++) {
 			if (packet_type == packet_type::none) {
 				uint8_t packet;
 				file.read((char *)&packet, sizeof(packet));
@@ -236,7 +247,7 @@ std::errc model_t::load_texture(const char *filename) noexcept
 				file.read((char *)&color, 3); /* bpp == 24, TODO: enianness */
 			}
 
-			texture_image_[y * texture_width_ + x] = color;
+			image[y * width + x] = color;
 			if (--cnt == 0)
 				packet_type = packet_type::none;
 		}
@@ -245,117 +256,143 @@ std::errc model_t::load_texture(const char *filename) noexcept
 	return {};
 }
 
-model_t::model_t(const char *model_filename, const char *texture_filename) noexcept
+std::errc model_t::parse_line(std::string& str) noexcept
 {
-	is_loaded_ = false;
+	/* TODO: use string_view to avoid copy */
+	trim(str);
 
-	std::ifstream file(model_filename);
-	if (!file.is_open()) {
-		std::cerr << "Failed to open " << std::quoted(model_filename) << "\n";
-		return;
+	if (str[0] == '#' || str.empty()) {
+		/* a comment or empty line */
+		return {};
 	}
 
-	std::string str;
-
-	while (std::getline(file, str)) {
-		/* TODO: use string_view to avoid copy */
-		trim(str);
-
-		if (str[0] == '#' || str.empty()) {
-			/* a comment or empty line */
-			continue;
-		}
-
-		if (str.starts_with("v ")) {
-			/* TODO: list of geometric vertices, with (x, y, z [,w])
-			 * coordinates, w is optional and defaults to 1.0.
-			 */
-			auto coord = parse_coord({ str.begin() + 2, str.end() });
-			if (coord.size() != 3) {
-				std::cerr << "Unexpected vertex: " << std::quoted(str) << ". {";
-				for (auto f : coord) {
-					std::cerr << " " << f;
-				}
-				std::cerr << " }\n";
-				return;
+	if (str.starts_with("v ")) {
+		/* TODO: list of geometric vertices, with (x, y, z [,w])
+		 * coordinates, w is optional and defaults to 1.0.
+		 */
+		auto coord = parse_coord({ str.begin() + 2, str.end() });
+		if (coord.size() != 3) {
+			std::cerr << "Unexpected vertex: " << std::quoted(str) << ". {";
+			for (auto f : coord) {
+				std::cerr << " " << f;
 			}
-			vertices_.push_back(coord);
-			continue;
+			std::cerr << " }\n";
+			return std::errc::invalid_argument;
 		}
+		vertices_.push_back(coord);
+		return {};
+	}
 
-		if (str.starts_with("vn ")) {
-			/* TODO: List of vertex normals in (x,y,z) form; normals might not
-			 * be unit vectors. */
-			auto coord = parse_coord({ str.begin() + 2, str.end() });
-			if (coord.size() != 3) {
-				std::cerr << "Unexpected normal: " << std::quoted(str) << ". {";
-				for (auto f : coord) {
-					std::cerr << " " << f;
-				}
-				std::cerr << " }\n";
-				return;
+	if (str.starts_with("vn ")) {
+		/* TODO: List of vertex normals in (x,y,z) form; normals might not
+		 * be unit vectors. */
+		auto coord = parse_coord({ str.begin() + 2, str.end() });
+		if (coord.size() != 3) {
+			std::cerr << "Unexpected normal: " << std::quoted(str) << ". {";
+			for (auto f : coord) {
+				std::cerr << " " << f;
 			}
-			normals_.push_back(coord);
-
-			continue;
+			std::cerr << " }\n";
+			return std::errc::invalid_argument;
 		}
+		normals_.push_back(coord);
 
-		if (str.starts_with("vt ")) {
-			/* TODO: List of texture coordinates, in (u, [,v ,w]) coordinates,
-			 * these will vary between 0 and 1. v, w are optional and default to
-			 * 0. */
-			auto coord = parse_coord({ str.begin() + 2, str.end() });
-			if (coord.size() != 2 && coord.size() != 3) {
-				std::cerr << "Unexpected texture: " << std::quoted(str) << ". {";
-				for (auto f : coord) {
-					std::cerr << " " << f;
-				}
-				std::cerr << " }\n";
-				return;
-			}
-			if (coord.size() == 3) {
-				/* TODO: handle w */
-				coord.pop_back();
+		return {};
+	}
+
+	if (str.starts_with("vt ")) {
+		/* TODO: List of texture coordinates, in (u, [,v ,w]) coordinates,
+		 * these will vary between 0 and 1. v, w are optional and default to
+		 * 0. */
+		auto coord = parse_coord({ str.begin() + 2, str.end() });
+		if (coord.size() != 2 && coord.size() != 3) {
+			std::cerr << "Unexpected texture: " << std::quoted(str) << ". {";
+			for (auto f : coord) {
+				std::cerr << " " << f;
 			}
-			texture_.push_back(coord);
-			continue;
+			std::cerr << " }\n";
+			return std::errc::invalid_argument;
 		}
-
-		if (str.starts_with("f ")) {
-			/* TODO: Polygonal face element (see below)
-			 * f 1 2 3             # Vertex indices
-			 * f 3/1 4/2 5/3       # Vertex texture coordinate indices
-			 * f 6/4/1 3/5/3 7/6/5 # Vertex normal indices
-			 * f 7//1 8//2 9//3    # Vertex normal indices w/o texture coordinates
-			 */
-			auto faces = parse_faces({ str.begin() + 2, str.end() });
-			/* TODO: check if faces are valid */
-			faces_.push_back(faces);
-			continue;
+		if (coord.size() == 3) {
+			/* TODO: handle w */
+			coord.pop_back();
 		}
+		texture_.push_back(coord);
+		return {};
+	}
 
-		if (str.starts_with("g ") || (str.size() == 1 && str[0] == 'g')) {
-			/* skip group name */
-			continue;
-		}
+	if (str.starts_with("f ")) {
+		/* TODO: Polygonal face element (see below)
+		 * f 1 2 3             # Vertex indices
+		 * f 3/1 4/2 5/3       # Vertex texture coordinate indices
+		 * f 6/4/1 3/5/3 7/6/5 # Vertex normal indices
+		 * f 7//1 8//2 9//3    # Vertex normal indices w/o texture coordinates
+		 */
+		auto faces = parse_faces({ str.begin() + 2, str.end() });
+		/* TODO: check if faces are valid */
+		faces_.push_back(faces);
+		face_materials_.push_back(current_material_);
+		return {};
+	}
 
-		if (str.starts_with("s ")) {
-			/* skip smooth shading */
-			continue;
-		}
+	if (str.starts_with("g ") || (str.size() == 1 && str[0] == 'g')) {
+		/* skip group name */
+		return {};
+	}
 
-		if (str.starts_with("mtllib")) {
-			/* skip material lib */
-			continue;
-		}
+	if (str.starts_with("s ")) {
+		/* skip smooth shading */
+		return {};
+	}
+
+	if (str.starts_with("mtllib ")) {
+		/* material libraries are loaded by load_materials() */
+		std::istringstream libs(str.substr(7));
+		for (std::string lib; libs >> lib;)
+			material_libs_.push_back(lib);
+		return {};
+	}
 
-		if (str.starts_with("usemtl ")) {
-			/* skip material name */
-			continue;
+	if (str.starts_with("usemtl ")) {
+		std::string name = str.substr(7);
+		trim(name);
+		auto it = std::find_if(materials_.begin(), materials_.end(), [&name](const Material& m) {
+			return m.name == name;
+		});
+		current_material_ = (int)(it - materials_.begin());
+		if (it == materials_.end()) {
+			materials_.emplace_back();
+			materials_.back().name = name;
 		}
+		return {};
+	}
+
+	/* TODO: Log warning */
+	assert(false);
+	return {};
+}
+
+model_t::model_t(void) noexcept
+	: is_loaded_(false)
+{
+}
 
-		/* TODO: Log warning */
-		assert(false);
+model_t::model_t(const char *model_filename, const char *texture_filename) noexcept
+{
+	PROFILE_ZONE("load model");
+	is_loaded_ = false;
+
+	std::ifstream file(model_filename);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open " << std::quoted(model_filename) << "\n";
+		return;
+	}
+
+	std::string str;
+
+	while (std::getline(file, str)) {
+		if (parse_line(str) != std::errc())
+			return;
 	}
 
 	std::cerr << "Model " << std::quoted(model_filename) << " loaded. Faces: " <<
@@ -367,6 +404,11 @@ model_t::model_t(const char *model_filename, const char *texture_filename) noexc
 		return;
 	}
 
+	/* missing materials keep the defaults */
+	if (load_materials(model_filename) != std::errc())
+		std::cerr << "Material loading failed\n";
+	group_by_material();
+
 	is_loaded_ = true;
 }
 
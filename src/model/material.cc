@@ -0,0 +1,112 @@
+/**
+ * MTL material libraries and grouping of faces by material.
+ */
+#include "model.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <profile/profile.h>
+
+/* Directory of a file with the trailing separator, empty for the current one */
+static std::string get_directory(const std::string& filename)
+{
+	size_t sep = filename.find_last_of("/\\");
+
+	return sep == std::string::npos ? std::string() : filename.substr(0, sep + 1);
+}
+
+std::errc model_t::load_materials(const char *model_filename) noexcept
+{
+	PROFILE_ZONE("load materials");
+	const std::string dir = get_directory(model_filename);
+	std::errc ret{};
+
+	for (const auto& lib : material_libs_) {
+		const std::string lib_filename = dir + lib;
+		std::ifstream file(lib_filename);
+		if (!file.is_open()) {
+			std::cerr << "Failed to open " << std::quoted(lib_filename) << "\n";
+			ret = std::errc::no_such_file_or_directory;
+			continue;
+		}
+
+		/* texture maps are relative to the library */
+		const std::string lib_dir = get_directory(lib_filename);
+		Material *m = nullptr;
+		std::string str;
+
+		while (std::getline(file, str)) {
+			std::istringstream line(str);
+			std::string keyword;
+			line >> keyword;
+
+			if (keyword == "newmtl") {
+				std::string name;
+				line >> name;
+				auto it = std::find_if(materials_.begin(), materials_.end(), [&name](const Material& mat) {
+					return mat.name == name;
+				});
+				/* not used by faces, skip */
+				m = it != materials_.end() ? &*it : nullptr;
+				continue;
+			}
+			if (!m)
+				continue;
+
+			if (keyword == "Kd") {
+				line >> m->diffuse[0] >> m->diffuse[1] >> m->diffuse[2];
+			} else if (keyword == "map_Kd") {
+				/* options (-s, -o, ...) are not supported, the file name
+				 * is the last one
+				 */
+				std::string map;
+				for (std::string word; line >> word;)
+					map = word;
+
+				const std::string map_filename = lib_dir + map;
+				m->texture = textures::open(map_filename.c_str());
+				if (m->texture == textures::NONE)
+					ret = std::errc::no_such_file_or_directory;
+			}
+			/* other properties (Ka, Ks, Ns, d, illum, ...) are ignored */
+		}
+	}
+
+	return ret;
+}
+
+void model_t::group_by_material(void) noexcept
+{
+	ranges_.clear();
+	if (faces_.empty())
+		return;
+
+	/* faces added without parse_line() have no material */
+	face_materials_.resize(faces_.size(), -1);
+
+	std::vector<uint32_t> order(faces_.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return face_materials_[a] < face_materials_[b];
+	});
+
+	std::vector<Face> faces;
+	faces.reserve(faces_.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		int material = face_materials_[order[i]];
+		if (ranges_.empty() || ranges_.back().material != material)
+			ranges_.push_back({ material, i, 0 });
+		ranges_.back().count++;
+		faces.push_back(faces_[order[i]]);
+	}
+
+	faces_ = std::move(faces);
+	/* ranges_ tell materials of faces from now on */
+	face_materials_.clear();
+	face_materials_.shrink_to_fit();
+}
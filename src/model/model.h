@@ -1,8 +1,11 @@
 #ifndef MODEL_H_
 #define MODEL_H_
 
+#include <cstdint>
+#include <string>
 #include <system_error>
 #include <vector>
+#include <textures/textures.h>
 
 class model_t {
 public:
@@ -12,6 +15,20 @@ public:
 		int n_idx[3];
 	};
 
+	/** A material of an MTL library */
+	struct Material {
+		std::string name;
+		float diffuse[3] = { 1.f, 1.f, 1.f };    /* Kd, RGB 0.0 - 1.0 */
+		textures::id_t texture = textures::NONE; /* map_Kd */
+	};
+
+	/** Faces of a material: faces_[first] ... faces_[first + count - 1] */
+	struct Range {
+		int material; /* index in materials_, -1 - the model texture */
+		size_t first;
+		size_t count;
+	};
+
 	/** Load a model.
 	 * Model data may be loaded to memory by bootloader or loaded from a file.
 	 * This class automatically handles OS/bare metal differences and constructs
@@ -25,19 +42,81 @@ public:
 	 */
 	model_t(const char *model_filename, const char *texture_filename) noexcept;
 
+	/** An empty model, e.g. to be filled by model_stream_t */
+	model_t(void) noexcept;
+
 	bool is_loaded(void) const noexcept;
 
+	/** Optimize the model for rendering
+	 * Faces are reordered within material ranges for reuse of transformed
+	 * vertices (Tipsify), then vertex data is reordered in the order of the
+	 * first use by faces, so vertex fetches go mostly forward in memory.
+	 * Meant to be called once, after loading.
+	 *
+	 * @param cache_size: vertices in the post-transform cache to optimize
+	 * for.
+	 */
+	void optimize(unsigned cache_size = 16) noexcept;
+
+	/** Get average cache miss ratio of the face order
+	 * The number of vertices transformed per face with a FIFO post-transform
+	 * cache: 3 without any reuse, about 0.5 at best for a regular mesh.
+	 *
+	 * @param cache_size: vertices in the cache.
+	 */
+	float get_acmr(unsigned cache_size = 16) const noexcept;
+
 //private:
 	std::errc load_texture(const char *filename) noexcept;
 
+	/** Parse a line of an OBJ file and append its data
+	 *
+	 * @param str: the line, trimmed in place.
+	 * @return an error of a malformed line.
+	 */
+	std::errc parse_line(std::string& str) noexcept;
+
+	/** Load materials of MTL libraries referred by the OBJ file
+	 * Only materials used by faces are loaded, their diffuse color and TGA
+	 * texture. Textures are opened in the texture cache and decoded when
+	 * drawn. A material missing from the libraries keeps the defaults.
+	 *
+	 * @param model_filename: the OBJ file, libraries are relative to it.
+	 * @return an error of a missing library or texture.
+	 */
+	std::errc load_materials(const char *model_filename) noexcept;
+
+	/** Sort faces by material, keeping their order within a material, and
+	 * build ranges_. Called once faces are parsed.
+	 */
+	void group_by_material(void) noexcept;
+
+	/** Load a TGA image
+	 *
+	 * @param filename: the file.
+	 * @param image: output, colors in RGB888 format.
+	 * @param width, height: output, image size.
+	 * @return an error of a missing or unsupported file.
+	 */
+	static std::errc load_tga(const char *filename, std::vector<uint32_t>& image,
+		size_t& width, size_t& height) noexcept;
+
 	bool is_loaded_;
 	std::vector<Face> faces_;
 	std::vector<std::vector<float>> vertices_;
 	std::vector<std::vector<float>> normals_;
 	std::vector<std::vector<float>> texture_;
-	std::vector<uint32_t> texture_image_; /* colors in RGB888 format */
-	size_t texture_width_;
-	size_t texture_height_;
+	/* decoded by the texture cache on demand */
+	textures::id_t texture_id_ = textures::NONE;
+	/* the finest mip level drawn, e.g. a preview while streaming */
+	unsigned texture_lod_ = 0;
+	std::vector<Material> materials_;
+	/* faces sorted by material, see group_by_material() */
+	std::vector<Range> ranges_;
+	/* loading state: MTL libraries, material of every face, the current one */
+	std::vector<std::string> material_libs_;
+	std::vector<int> face_materials_;
+	int current_material_ = -1;
 };
 
 #endif /* MODEL_H_ */
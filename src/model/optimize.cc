@@ -0,0 +1,232 @@
+/**
+ * Load time optimization of the face order for post-transform vertex cache
+ * reuse and of the vertex data order for fetch locality.
+ */
+#include "model.h"
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <tuple>
+#include <vector>
+#include <profile/profile.h>
+
+/* Number unique vertices of faces. A vertex is a combination of position,
+ * texture coordinates and normal indices, so is a vertex after the vertex
+ * stage. Vertices are numbered in the order of their position indices.
+ *
+ * @param faces: faces to number vertices of.
+ * @param ids: output, id of corner c of face f is ids[3 * f + c].
+ * @return number of unique vertices.
+ */
+static size_t index_vertices(std::span<const model_t::Face> faces, std::vector<uint32_t>& ids)
+{
+	auto key = [&faces](uint32_t corner) {
+		const auto& f = faces[corner / 3];
+		return std::tie(f.v_idx[corner % 3], f.tex_idx[corner % 3], f.n_idx[corner % 3]);
+	};
+
+	std::vector<uint32_t> corners(faces.size() * 3);
+	std::iota(corners.begin(), corners.end(), 0);
+	std::sort(corners.begin(), corners.end(), [&key](uint32_t a, uint32_t b) {
+		return key(a) < key(b);
+	});
+
+	ids.resize(corners.size());
+	size_t count = 0;
+	for (size_t i = 0; i < corners.size(); i++) {
+		if (i && key(corners[i]) != key(corners[i - 1]))
+			count++;
+		ids[corners[i]] = (uint32_t)count;
+	}
+
+	return corners.empty() ? 0 : count + 1;
+}
+
+/* Tipsify (Sander, Nehab, Barczak, "Fast triangle reordering for vertex
+ * locality and reduced overdraw", 2007). Faces are emitted as fans around a
+ * vertex, the next fan vertex is a neighbour which stays in the cache the
+ * longest after its remaining faces are emitted.
+ *
+ * @param ids: vertex ids of face corners, see index_vertices().
+ * @param count: number of vertices.
+ * @param cache_size: FIFO cache size to optimize for.
+ * @return the new face order.
+ */
+static std::vector<uint32_t> tipsify(const std::vector<uint32_t>& ids, size_t count, unsigned cache_size)
+{
+	const size_t faces = ids.size() / 3;
+
+	/* faces using a vertex: adjacency[offset[v]] ... adjacency[offset[v + 1] - 1] */
+	std::vector<uint32_t> offset(count + 1, 0);
+	for (uint32_t v : ids)
+		offset[v + 1]++;
+	std::partial_sum(offset.begin(), offset.end(), offset.begin());
+	std::vector<uint32_t> adjacency(ids.size());
+	std::vector<uint32_t> cursor(offset.begin(), offset.end() - 1);
+	for (size_t i = 0; i < ids.size(); i++)
+		adjacency[cursor[ids[i]]++] = (uint32_t)(i / 3);
+
+	/* faces not emitted yet per vertex */
+	std::vector<uint32_t> live(count);
+	for (size_t v = 0; v < count; v++)
+		live[v] = offset[v + 1] - offset[v];
+
+	/* A vertex is in the cache if it entered it less than cache_size misses
+	 * ago: time - stamp[v] <= cache_size. The time starts past the cache size,
+	 * so nothing is cached at first.
+	 */
+	std::vector<uint32_t> stamp(count, 0);
+	uint32_t time = cache_size + 1;
+
+	std::vector<uint8_t> emitted(faces, 0);
+	std::vector<uint32_t> dead_end;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> order;
+	order.reserve(faces);
+
+	size_t next = 0;
+	for (int64_t fan = count ? 0 : -1; fan >= 0;) {
+		candidates.clear();
+		for (uint32_t k = offset[fan]; k < offset[fan + 1]; k++) {
+			uint32_t f = adjacency[k];
+			if (emitted[f])
+				continue;
+
+			for (size_t c = 0; c < 3; c++) {
+				uint32_t v = ids[3 * f + c];
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - stamp[v] > cache_size)
+					stamp[v] = time++;
+			}
+			emitted[f] = 1;
+			order.push_back(f);
+		}
+
+		/* a neighbour with faces left, which stays cached the longest */
+		fan = -1;
+		int64_t best = -1;
+		for (uint32_t v : candidates) {
+			if (!live[v])
+				continue;
+			int64_t priority = 0;
+			if (time - stamp[v] + 2 * (int64_t)live[v] <= cache_size)
+				priority = time - stamp[v];
+			if (priority > best) {
+				best = priority;
+				fan = v;
+			}
+		}
+		if (fan >= 0)
+			continue;
+
+		/* a dead end: a recently used vertex or the next one in order */
+		while (!dead_end.empty() && fan < 0) {
+			uint32_t v = dead_end.back();
+			dead_end.pop_back();
+			if (live[v])
+				fan = v;
+		}
+		for (; next < count && fan < 0; next++) {
+			if (live[next])
+				fan = (int64_t)next;
+		}
+	}
+
+	return order;
+}
+
+/* Renumber vertex data in the order of the first use by faces. Unused data
+ * keeps its order after the used one.
+ *
+ * @param faces: faces referring to the data by 1-based indices.
+ * @param idx: the face indices to the data.
+ * @param data: the data.
+ */
+static void reorder_by_first_use(std::vector<model_t::Face>& faces, int (model_t::Face::*idx)[3],
+	std::vector<std::vector<float>>& data)
+{
+	constexpr uint32_t NONE = UINT32_MAX;
+
+	std::vector<uint32_t> remap(data.size(), NONE);
+	std::vector<std::vector<float>> sorted;
+	sorted.reserve(data.size());
+
+	/* copied rather than moved: new allocations follow the order of use */
+	for (auto& face : faces) {
+		for (int& i : face.*idx) {
+			/* invalid indices are left as is */
+			if (i < 1 || (size_t)i > data.size())
+				continue;
+
+			uint32_t& r = remap[(size_t)i - 1];
+			if (r == NONE) {
+				r = (uint32_t)sorted.size();
+				sorted.push_back(data[(size_t)i - 1]);
+			}
+			i = (int)r + 1;
+		}
+	}
+	for (size_t i = 0; i < data.size(); i++) {
+		if (remap[i] == NONE)
+			sorted.push_back(data[i]);
+	}
+
+	data = std::move(sorted);
+}
+
+void model_t::optimize(unsigned cache_size) noexcept
+{
+	if (faces_.empty() || !cache_size)
+		return;
+
+	PROFILE_ZONE("optimize model");
+	std::vector<Face> faces;
+	faces.reserve(faces_.size());
+
+	/* faces are reordered within a material, so ranges stay as they are */
+	auto reorder = [&](size_t first, size_t count) {
+		std::span<const Face> range(faces_.data() + first, count);
+		std::vector<uint32_t> ids;
+		size_t vertices = index_vertices(range, ids);
+
+		for (uint32_t f : tipsify(ids, vertices, cache_size))
+			faces.push_back(range[f]);
+	};
+	if (ranges_.empty()) {
+		reorder(0, faces_.size());
+	} else {
+		for (const auto& r : ranges_)
+			reorder(r.first, r.count);
+	}
+	faces_ = std::move(faces);
+
+	reorder_by_first_use(faces_, &Face::v_idx, vertices_);
+	reorder_by_first_use(faces_, &Face::tex_idx, texture_);
+	reorder_by_first_use(faces_, &Face::n_idx, normals_);
+}
+
+float model_t::get_acmr(unsigned cache_size) const noexcept
+{
+	if (faces_.empty())
+		return 0.f;
+
+	std::vector<uint32_t> ids;
+	size_t count = index_vertices(faces_, ids);
+
+	/* FIFO cache, see tipsify() */
+	std::vector<uint32_t> stamp(count, 0);
+	uint32_t time = cache_size + 1;
+	size_t misses = 0;
+
+	for (uint32_t v : ids) {
+		if (time - stamp[v] > cache_size) {
+			stamp[v] = time++;
+			misses++;
+		}
+	}
+
+	return (float)misses / (float)faces_.size();
+}
@@ -0,0 +1,167 @@
+/**
+ * Streaming model loading: a background thread parses the model and
+ * publishes parts of it to the render thread.
+ */
+#include "stream.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <vector>
+#include <profile/profile.h>
+
+/* Faces of the first batch. Batches double up to MAX_BATCH, so the first
+ * frames get faces soon and a large model takes few updates.
+ */
+static constexpr size_t FIRST_BATCH = 1024;
+static constexpr size_t MAX_BATCH = 1 << 16;
+
+/* Mip level of the texture drawn till the model is complete */
+static constexpr unsigned PREVIEW_LEVEL = 3;
+
+/* Append elements of src to dst */
+template <typename T>
+static void append(std::vector<T>& dst, std::vector<T>& src)
+{
+	dst.insert(dst.end(), std::make_move_iterator(src.begin()), std::make_move_iterator(src.end()));
+	src.clear();
+}
+
+/* Copy elements of src from first to dst */
+template <typename T>
+static void copy_tail(std::vector<T>& dst, const std::vector<T>& src, size_t first)
+{
+	dst.insert(dst.end(), src.begin() + first, src.end());
+}
+
+model_stream_t::model_stream_t(const char *model_filename, const char *texture_filename) noexcept
+	: model_filename_(model_filename), texture_filename_(texture_filename), cancel_(false),
+	state_(state::loading), texture_pending_(false), final_pending_(false),
+	thread_(&model_stream_t::load, this)
+{
+}
+
+model_stream_t::~model_stream_t()
+{
+	cancel_.store(true, std::memory_order_relaxed);
+	thread_.join();
+}
+
+bool model_stream_t::is_pending(void) const noexcept
+{
+	std::lock_guard<std::mutex> g(lock_);
+	return !pending_.faces_.empty() || texture_pending_ || final_pending_ || state_ == state::failed;
+}
+
+model_stream_t::state model_stream_t::update(model_t& model) noexcept
+{
+	std::lock_guard<std::mutex> g(lock_);
+
+	if (final_pending_) {
+		model = std::move(final_);
+		final_pending_ = false;
+		texture_pending_ = false;
+		pending_ = model_t();
+		return state_;
+	}
+
+	append(model.faces_, pending_.faces_);
+	append(model.vertices_, pending_.vertices_);
+	append(model.normals_, pending_.normals_);
+	append(model.texture_, pending_.texture_);
+
+	if (texture_pending_) {
+		model.texture_id_ = pending_.texture_id_;
+		model.texture_lod_ = pending_.texture_lod_;
+		texture_pending_ = false;
+	}
+
+	return state_;
+}
+
+/* Publish data of the model parsed since the last call
+ *
+ * @param all: the model being parsed.
+ * @param published: sizes of the part published so far, updated.
+ */
+void model_stream_t::publish(const model_t& all, sizes_t& published) noexcept
+{
+	std::lock_guard<std::mutex> g(lock_);
+
+	copy_tail(pending_.faces_, all.faces_, published.faces);
+	copy_tail(pending_.vertices_, all.vertices_, published.vertices);
+	copy_tail(pending_.normals_, all.normals_, published.normals);
+	copy_tail(pending_.texture_, all.texture_, published.texture);
+
+	published = { all.faces_.size(), all.vertices_.size(), all.normals_.size(), all.texture_.size() };
+}
+
+void model_stream_t::fail(void) noexcept
+{
+	std::lock_guard<std::mutex> g(lock_);
+	state_ = state::failed;
+}
+
+void model_stream_t::load(void) noexcept
+{
+	PROFILE_ZONE("stream model");
+	model_t all;
+
+	/* the texture is small next to a large model, prefetch it first: faces
+	 * are drawn with a coarse mip level till the model is complete
+	 */
+	if (all.load_texture(texture_filename_.c_str()) != std::errc()) {
+		std::cerr << "Texture loading failed\n";
+		fail();
+		return;
+	}
+	textures::get(all.texture_id_, 0);
+	textures::get(all.texture_id_, PREVIEW_LEVEL);
+	{
+		std::lock_guard<std::mutex> g(lock_);
+		pending_.texture_id_ = all.texture_id_;
+		pending_.texture_lod_ = PREVIEW_LEVEL;
+		texture_pending_ = true;
+	}
+
+	std::ifstream file(model_filename_);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open " << std::quoted(model_filename_) << "\n";
+		fail();
+		return;
+	}
+
+	sizes_t published;
+	size_t batch = FIRST_BATCH;
+	std::string str;
+
+	while (std::getline(file, str)) {
+		if (cancel_.load(std::memory_order_relaxed))
+			return;
+		if (all.parse_line(str) != std::errc()) {
+			fail();
+			return;
+		}
+		if (all.faces_.size() - published.faces >= batch) {
+			publish(all, published);
+			batch = std::min(batch * 2, MAX_BATCH);
+		}
+	}
+	publish(all, published);
+
+	std::cerr << "Model " << std::quoted(model_filename_) << " loaded. Faces: " <<
+		all.faces_.size() << ", Vertices: " << all.vertices_.size() <<
+		", Normals: " << all.normals_.size() << "\n";
+
+	if (all.load_materials(model_filename_.c_str()) != std::errc())
+		std::cerr << "Material loading failed\n";
+	all.group_by_material();
+	all.optimize();
+	all.is_loaded_ = true;
+
+	std::lock_guard<std::mutex> g(lock_);
+	final_ = std::move(all);
+	final_pending_ = true;
+	state_ = state::loaded;
+}
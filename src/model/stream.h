@@ -0,0 +1,89 @@
+#ifndef MODEL_STREAM_H_
+#define MODEL_STREAM_H_
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <model/model.h>
+
+/** Load a model on a background thread, a part at a time
+ * The texture is prefetched to the texture cache first and drawn at a coarse
+ * mip level, then faces are published in batches of growing size as they are
+ * parsed. At the end materials are loaded, the whole model is grouped by
+ * material and optimized (see model_t::optimize()) and replaces the parts,
+ * drawn at the full texture resolution. So a frame can be drawn while
+ * loading, showing what is resident so far.
+ *
+ *	model_t obj;
+ *	model_stream_t stream("model.obj", "texture.tga");
+ *	...
+ *	if (stream.is_pending()) {
+ *		render::flush();
+ *		stream.update(obj);
+ *	}
+ */
+class model_stream_t {
+public:
+	enum class state {
+		loading,
+		loaded,
+		failed,
+	};
+
+	/** Start loading
+	 *
+	 * @param model_filename: .obj file to load.
+	 * @param texture_filename: .tga texture to load.
+	 */
+	model_stream_t(const char *model_filename, const char *texture_filename) noexcept;
+
+	/** Stop loading and wait for the thread */
+	~model_stream_t();
+
+	model_stream_t(const model_stream_t&) = delete;
+	model_stream_t& operator=(const model_stream_t&) = delete;
+
+	/** Check if update() has data to move to the model or loading failed */
+	bool is_pending(void) const noexcept;
+
+	/** Move data loaded since the last call to a model
+	 * Faces and vertex data are appended, the texture and the final model
+	 * replace the current ones. Data of the model may be reallocated, so it
+	 * must not be in use, e.g. by a pipelined frame (see render::flush()).
+	 *
+	 * @param model: the model, empty before the first call.
+	 * @return the loading state: state::loaded once the model is complete.
+	 */
+	state update(model_t& model) noexcept;
+
+private:
+	/* sizes of model data */
+	struct sizes_t {
+		size_t faces = 0;
+		size_t vertices = 0;
+		size_t normals = 0;
+		size_t texture = 0;
+	};
+
+	void load(void) noexcept;
+	void publish(const model_t& all, sizes_t& published) noexcept;
+	void fail(void) noexcept;
+
+	std::string model_filename_;
+	std::string texture_filename_;
+	std::atomic<bool> cancel_;
+
+	mutable std::mutex lock_;
+	/* guarded by lock_ */
+	state state_;
+	model_t pending_;
+	bool texture_pending_;
+	model_t final_;
+	bool final_pending_;
+
+	/* started last, when the rest is initialized */
+	std::thread thread_;
+};
+
+#endif /* MODEL_STREAM_H_ */
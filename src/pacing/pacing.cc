@@ -0,0 +1,97 @@
+#include "pacing.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <display/display.h>
+
+pacing::scheduler_t::scheduler_t(float fps, float tick_hz) noexcept
+{
+	using namespace std::chrono;
+
+	frame_period_ = fps > 0.f ? duration_cast<clock::duration>(duration<float>(1.f / fps)) : clock::duration::zero();
+	tick_ = duration_cast<clock::duration>(duration<float>(1.f / tick_hz));
+	lag_ = clock::duration::zero();
+	last_ = deadline_ = clock::now();
+	/* the first frame has no previous one to measure the interval from */
+	resumed_ = true;
+	reset_stats();
+}
+
+unsigned pacing::scheduler_t::begin_frame(void) noexcept
+{
+	auto now = clock::now();
+
+	if (resumed_) {
+		/* pace from this frame on */
+		resumed_ = false;
+		deadline_ = now;
+	} else {
+		std::chrono::duration<double, std::milli> interval = now - last_;
+		frames_++;
+		sum_ms_ += interval.count();
+		sum_sq_ms_ += interval.count() * interval.count();
+		max_ms_ = std::max(max_ms_, (float)interval.count());
+		lag_ += now - last_;
+	}
+	last_ = now;
+
+	unsigned ticks = (unsigned)(lag_ / tick_);
+	if (ticks > MAX_TICKS) {
+		ticks = MAX_TICKS;
+		lag_ = clock::duration::zero();
+	} else {
+		lag_ -= ticks * tick_;
+	}
+
+	return ticks;
+}
+
+void pacing::scheduler_t::end_frame(bool animating) noexcept
+{
+	if (!animating) {
+		display::wait_msg();
+		resumed_ = true;
+		lag_ = clock::duration::zero();
+		return;
+	}
+
+	if (frame_period_ == clock::duration::zero())
+		return;
+
+	/* the deadline advances by the period, so sleep errors don't add up */
+	auto now = clock::now();
+	deadline_ += frame_period_;
+	if (deadline_ <= now) {
+		/* the frame is late: don't try to catch up */
+		deadline_ = now;
+		return;
+	}
+
+	std::this_thread::sleep_until(deadline_);
+}
+
+float pacing::scheduler_t::get_tick(void) const noexcept
+{
+	return std::chrono::duration<float>(tick_).count();
+}
+
+pacing::stats_t pacing::scheduler_t::get_stats(void) const noexcept
+{
+	stats_t stats{ frames_, 0.f, 0.f, max_ms_ };
+
+	if (frames_) {
+		double mean = sum_ms_ / frames_;
+		double var = sum_sq_ms_ / frames_ - mean * mean;
+		stats.mean_ms = (float)mean;
+		stats.jitter_ms = (float)std::sqrt(std::max(var, 0.));
+	}
+
+	return stats;
+}
+
+void pacing::scheduler_t::reset_stats(void) noexcept
+{
+	frames_ = 0;
+	sum_ms_ = sum_sq_ms_ = 0.;
+	max_ms_ = 0.f;
+}
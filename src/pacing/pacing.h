@@ -0,0 +1,89 @@
+#ifndef PACING_PACING_H_
+#define PACING_PACING_H_
+
+#include <chrono>
+
+/* Frame pacing
+ *
+ * The main loop is split to simulation and drawing. Simulation advances in
+ * fixed time steps (ticks), so animation speed doesn't depend on frame rate.
+ * Drawing is limited to the target frame rate: the loop sleeps until the next
+ * frame is due instead of spinning. If nothing animates the loop sleeps until
+ * the display posts an event.
+ *
+ * A typical loop:
+ *
+ *	for (;;) {
+ *		while (display::get_msg(m))
+ *			...
+ *		for (unsigned n = sched.begin_frame(); n; n--)
+ *			... advance simulation by sched.get_tick() seconds
+ *		... draw
+ *		sched.end_frame(animating);
+ *	}
+ */
+namespace pacing {
+
+/** Frame interval statistics */
+struct stats_t {
+	unsigned frames;  /**< number of measured intervals */
+	float mean_ms;    /**< average interval between frames */
+	float jitter_ms;  /**< standard deviation of the interval */
+	float max_ms;     /**< the longest interval */
+};
+
+class scheduler_t {
+public:
+	/** Create a scheduler
+	 *
+	 * @param fps: target frame rate. 0 - unlimited (e.g. when the display
+	 * waits for vsync itself).
+	 * @param tick_hz: simulation rate.
+	 */
+	scheduler_t(float fps = 60.f, float tick_hz = 50.f) noexcept;
+
+	/** Start a frame
+	 *
+	 * @return number of ticks to advance simulation by. If frames take too
+	 * long, the number is capped and simulation slows down instead of
+	 * taking more and more time to catch up.
+	 */
+	unsigned begin_frame(void) noexcept;
+
+	/** Finish a frame and sleep until the next one is due
+	 *
+	 * @param animating: false if the next frame would be the same as this
+	 * one. The function sleeps until the display posts an event then, and
+	 * the idle time is neither simulated nor counted in statistics.
+	 */
+	void end_frame(bool animating) noexcept;
+
+	/** Get duration of a tick in seconds */
+	float get_tick(void) const noexcept;
+
+	/** Get frame interval statistics collected since the last reset */
+	stats_t get_stats(void) const noexcept;
+	void reset_stats(void) noexcept;
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	/** the most ticks simulated per frame */
+	static constexpr unsigned MAX_TICKS = 5;
+
+	clock::duration frame_period_;
+	clock::duration tick_;
+	clock::duration lag_;         /**< simulation time not ticked yet */
+	clock::time_point last_;      /**< start of the previous frame */
+	clock::time_point deadline_;  /**< when the next frame is due */
+	bool resumed_;                /**< the previous frame was followed by idle */
+
+	unsigned frames_;
+	double sum_ms_;
+	double sum_sq_ms_;
+	float max_ms_;
+};
+
+} /* namespace pacing */
+
+#endif /* PACING_PACING_H_ */
@@ -0,0 +1,194 @@
+#include "profile.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+/* Zones kept per thread, the oldest ones are overwritten */
+static constexpr size_t RING_SIZE = 1 << 16;
+
+/* Fields are atomic: write_trace() may read a slot while it's overwritten */
+struct event_t {
+	std::atomic<const char *> name;
+	std::atomic<int64_t> begin;
+	std::atomic<int64_t> end;
+};
+
+/* Ring buffer of a thread. The thread is the only writer, a slot is
+ * published by the release store of head. Writers aren't stopped while the
+ * trace is written: a copied slot is only valid if head didn't wrap around
+ * to it meanwhile (a sequence lock, head is the sequence). Buffers are never
+ * freed: a zone may end after the capture, and a thread keeps its buffer for
+ * its lifetime.
+ */
+struct ring_t {
+	std::unique_ptr<event_t[]> events{ new event_t[RING_SIZE] };
+	/* zones written so far */
+	std::atomic<uint64_t> head{ 0 };
+	unsigned tid;
+	ring_t *next;
+};
+
+/* all the rings, pushed without locks */
+static std::atomic<ring_t *> rings;
+static std::atomic<unsigned> ring_count;
+
+static std::atomic<bool> recording;
+
+/* capture state, used by the thread calling frame() */
+static bool armed;
+static unsigned skip_frames;
+static unsigned capture_frames;
+static std::string output;
+static int64_t start_time;
+
+static ring_t *get_ring(void)
+{
+	static thread_local ring_t *ring;
+
+	if (!ring) {
+		ring = new ring_t;
+		ring->tid = ring_count.fetch_add(1, std::memory_order_relaxed);
+		ring->next = rings.load(std::memory_order_relaxed);
+		while (!rings.compare_exchange_weak(ring->next, ring, std::memory_order_release,
+			std::memory_order_relaxed));
+	}
+	return ring;
+}
+
+/* Write a string as a JSON string literal */
+static void write_string(std::FILE *f, const char *s)
+{
+	std::fputc('"', f);
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			std::fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			std::fprintf(f, "\\u%04x", c);
+		else
+			std::fputc(c, f);
+	}
+	std::fputc('"', f);
+}
+
+/* Write zones recorded since the capture start
+ *
+ * @return 0 on success.
+ */
+static int write_trace(const std::string& path)
+{
+	std::FILE *f = std::fopen(path.c_str(), "w");
+	if (!f) {
+		std::fprintf(stderr, "Failed to open \"%s\"\n", path.c_str());
+		return 1;
+	}
+
+	std::fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	bool first = true;
+	for (ring_t *r = rings.load(std::memory_order_acquire); r; r = r->next) {
+		std::fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+			"\"args\":{\"name\":\"thread %u\"}}", first ? "" : ",\n", r->tid, r->tid);
+		first = false;
+
+		uint64_t head = r->head.load(std::memory_order_acquire);
+		uint64_t tail = head > RING_SIZE ? head - RING_SIZE : 0;
+		for (uint64_t i = tail; i < head; i++) {
+			const event_t& slot = r->events[i % RING_SIZE];
+			const char *name = slot.name.load(std::memory_order_relaxed);
+			int64_t begin = slot.begin.load(std::memory_order_relaxed);
+			int64_t end = slot.end.load(std::memory_order_relaxed);
+
+			/* the writer started to overwrite the slot once head reached
+			 * i + RING_SIZE: the copy may be torn
+			 */
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (r->head.load(std::memory_order_relaxed) >= i + RING_SIZE)
+				continue;
+			if (begin < start_time)
+				continue;
+
+			/* microseconds relative to the capture start */
+			std::fprintf(f, ",\n{\"name\":");
+			write_string(f, name);
+			std::fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				r->tid, (begin - start_time) / 1000.0, (end - begin) / 1000.0);
+		}
+	}
+
+	std::fprintf(f, "\n]}\n");
+	return std::fclose(f) ? 1 : 0;
+}
+
+static void start(void)
+{
+	start_time = profile::now();
+	recording.store(true, std::memory_order_relaxed);
+}
+
+int profile::capture(unsigned skip, unsigned frames, const char *path)
+{
+	if (!frames || !path)
+		return 1;
+
+	recording.store(false, std::memory_order_relaxed);
+	skip_frames = skip;
+	capture_frames = frames;
+	output = path;
+	armed = true;
+
+	/* right away, to catch loading before the first frame */
+	if (!skip)
+		start();
+	return 0;
+}
+
+void profile::frame(void)
+{
+	if (!armed)
+		return;
+
+	if (skip_frames) {
+		skip_frames--;
+		return;
+	}
+	if (!is_recording())
+		start();
+
+	if (capture_frames) {
+		capture_frames--;
+		return;
+	}
+
+	recording.store(false, std::memory_order_relaxed);
+	armed = false;
+	if (write_trace(output))
+		std::fprintf(stderr, "Failed to write the trace\n");
+}
+
+bool profile::is_recording(void)
+{
+	return recording.load(std::memory_order_relaxed);
+}
+
+int64_t profile::now(void)
+{
+	auto t = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+}
+
+void profile::record(const char *name, int64_t begin, int64_t end)
+{
+	ring_t *r = get_ring();
+	uint64_t head = r->head.load(std::memory_order_relaxed);
+	event_t& slot = r->events[head % RING_SIZE];
+
+	/* a reader which sees any of the stores below sees head too */
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.begin.store(begin, std::memory_order_relaxed);
+	slot.end.store(end, std::memory_order_relaxed);
+	r->head.store(head + 1, std::memory_order_release);
+}
@@ -0,0 +1,87 @@
+#ifndef PROFILE_PROFILE_H_
+#define PROFILE_PROFILE_H_
+
+#include <cstdint>
+
+/* Profiling zones
+ *
+ * A zone is a scope timed by PROFILE_ZONE("name"). While a capture is
+ * running, zones are recorded by every thread to its own ring buffer without
+ * locks. At the end of the capture they are written out in Chrome trace_event
+ * JSON format, which chrome://tracing and Perfetto show as a timeline per
+ * thread.
+ *
+ *	void draw(void)
+ *	{
+ *		PROFILE_ZONE("draw");
+ *		...
+ *	}
+ *
+ * A zone costs a clock read at both ends while recording and a flag test
+ * otherwise. Define PROFILE_DISABLE to compile zones out entirely.
+ */
+namespace profile {
+
+/** Capture zones of a range of frames
+ * The capture starts after skip frames and stops after frames frames, then
+ * the trace is written to path. A capture in progress is replaced.
+ *
+ * @param skip: frames to skip, 0 - start right away, so zones before the
+ * first frame (e.g. loading) are captured too.
+ * @param frames: frames to capture.
+ * @param path: output file name.
+ * @return 0 on success.
+ */
+int capture(unsigned skip, unsigned frames, const char *path);
+
+/** Mark the start of a frame. Called by render::clear() */
+void frame(void);
+
+/** Check if zones are being recorded */
+bool is_recording(void);
+
+/** Get the time in nanoseconds of a monotonic clock */
+int64_t now(void);
+
+/** Record a zone of the calling thread
+ *
+ * @param name: a string which outlives the capture, e.g. a literal. It's
+ * escaped in the trace.
+ * @param begin, end: the zone time, see now().
+ */
+void record(const char *name, int64_t begin, int64_t end);
+
+/** A zone from construction to destruction, see PROFILE_ZONE() */
+class zone_t {
+public:
+	explicit zone_t(const char *name) noexcept
+		: name(name), begin(is_recording() ? now() : -1)
+	{
+	}
+
+	~zone_t()
+	{
+		if (begin >= 0)
+			record(name, begin, now());
+	}
+
+	zone_t(const zone_t&) = delete;
+	zone_t& operator=(const zone_t&) = delete;
+
+private:
+	const char *name;
+	int64_t begin;
+};
+
+} /* namespace profile */
+
+#if defined(PROFILE_DISABLE)
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+/** Time the rest of the enclosing scope as a zone */
+#define PROFILE_ZONE(name) ::profile::zone_t PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#endif
+
+#endif /* PROFILE_PROFILE_H_ */
@@ -0,0 +1,42 @@
+#ifndef RENDER_COLOR_H_
+#define RENDER_COLOR_H_
+
+#include <cstdint>
+
+namespace render {
+
+/** Get red component of a color in RGB888 format */
+inline uint8_t get_r(uint32_t color)
+{
+	return (color & 0xFF0000) >> 16;
+}
+
+/** Get green component of a color in RGB888 format */
+inline uint8_t get_g(uint32_t color)
+{
+	return (color & 0x00FF00) >> 8;
+}
+
+/** Get blue component of a color in RGB888 format */
+inline uint8_t get_b(uint32_t color)
+{
+	return color & 0x0000FF;
+}
+
+/** Make a color in RGB888 format from components (0.0 - 255.0) */
+inline uint32_t make_color(float r, float g, float b)
+{
+	return (uint32_t)r << 16 | (uint32_t)g << 8 | (uint32_t)b;
+}
+
+/** Make a gray color in RGB888 format from intensity (0.0 - 1.0) */
+inline uint32_t make_color(float intensity)
+{
+	uint32_t c = (uint32_t)(intensity * 255);
+
+	return c << 16 | c << 8 | c;
+}
+
+} /* namespace render */
+
+#endif /* RENDER_COLOR_H_ */
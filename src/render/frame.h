@@ -0,0 +1,75 @@
+#ifndef RENDER_FRAME_H_
+#define RENDER_FRAME_H_
+
+#include <memory>
+#include <utility>
+#include <jobs/jobs.h>
+#include <memory/memory.h>
+
+/* Frame packets for pipelined rendering (see render::pipelining_enable())
+ *
+ * Draw calls of a frame are recorded to a packet together with a snapshot of
+ * the state they depend on. The geometry of a draw is processed by a job
+ * right away, while the previous frame is still being rasterized. The packet
+ * is rasterized by a single job queued by render::update().
+ *
+ * Transient data of a frame (recorded draws, transformed and binned
+ * triangles) is allocated from arenas of its packet. The arenas are reset by
+ * render::clear(), when the packet is recorded again.
+ */
+namespace render::frame {
+
+/** A recorded draw call */
+struct draw_t {
+	virtual ~draw_t() = default;
+
+	/** Rasterize the draw to current surfaces. Called from the frame raster
+	 * job after the geometry job of the draw is finished.
+	 */
+	virtual void raster(void) = 0;
+};
+
+/** Arenas of a frame */
+struct memory_t {
+	/* padded: arenas of different threads don't share cache lines */
+	struct alignas(64) thread_arena_t {
+		memory::arena_t arena;
+	};
+
+	/** Used by the thread recording the frame only */
+	memory::arena_t frame;
+	/** One per job thread */
+	std::unique_ptr<thread_arena_t[]> threads;
+	unsigned thread_count = 0;
+
+	/** Get the arena of the calling job thread */
+	memory::arena_t& thread(void)
+	{
+		return threads[jobs::get_thread_index()].arena;
+	}
+
+	/** Reset all the arenas. Called when the frame isn't used by jobs */
+	void reset(void);
+};
+
+/** Get arenas of the frame being recorded */
+memory_t& get_memory(void);
+
+/** Construct a draw in the frame arena. It's destroyed with the packet */
+template <typename T, typename... A>
+T *create(A&&... args)
+{
+	return get_memory().frame.create<T>(std::forward<A>(args)...);
+}
+
+/** Add a draw to the packet being recorded
+ *
+ * @param draw: the draw made by create().
+ * @param geometry: a job preparing the draw or nullptr. The job is submitted
+ * by the call.
+ */
+void record(draw_t *draw, jobs::job_t *geometry = nullptr);
+
+} /* namespace render::frame */
+
+#endif /* RENDER_FRAME_H_ */
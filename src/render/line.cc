@@ -1,11 +1,17 @@
 #include "line.h"
+#include <algorithm>
 #include <cmath>
 #include <display/display.h>
+#include <memory>
 #include <matrix.h>
+#include <profile/profile.h>
+#include <render/frame.h>
+#include <render/msaa.h>
 #include <render/render.h>
 #include <render/zbuf.h>
+#include <utility>
 
-void render::line(int x0, int y0, int x1, int y1, uint32_t color)
+static void draw_line(int x0, int y0, int x1, int y1, uint32_t color)
 {
 	bool steep = false;
 	if (std::abs(x0 - x1) < std::abs(y0 - y1)) {
@@ -26,11 +32,13 @@ void render::line(int x0, int y0, int x1, int y1, uint32_t color)
 	int derr = std::abs(dy) * 2;
 	int err = 0;
 
+	auto fb = render::get_surface();
 	for (int x = x0, y = y0; x <= x1; x++) {
-		if (steep)
-			display::put(y, x, color);
-		else
-			display::put(x, y, color);
+		int px = steep ? y : x;
+		int py = steep ? x : y;
+
+		if (px >= 0 && py >= 0 && px < fb.width && py < fb.height)
+			fb.put(px, py, color);
 
 		err += derr;
 		if (err > dx) {
@@ -40,37 +48,135 @@ void render::line(int x0, int y0, int x1, int y1, uint32_t color)
 	}
 }
 
+/* A line in screen coordinates recorded to a frame packet */
+struct line_draw_t : render::frame::draw_t {
+	int x0, y0, x1, y1;
+	uint32_t color;
+
+	line_draw_t(int x0, int y0, int x1, int y1, uint32_t color)
+		: x0(x0), y0(y0), x1(x1), y1(y1), color(color)
+	{
+	}
+
+	void raster(void) override
+	{
+		draw_line(x0, y0, x1, y1, color);
+	}
+};
+
+void render::line(int x0, int y0, int x1, int y1, uint32_t color)
+{
+	PROFILE_ZONE("render::line");
+	if (is_pipelining_enabled())
+		frame::record(frame::create<line_draw_t>(x0, y0, x1, y1, color));
+	else
+		draw_line(x0, y0, x1, y1, color);
+}
+
 void render::line(vec2f_t p0, vec2f_t p1, uint32_t color)
 {
-	auto [width, height] = display::get_resolution();
-	int x0 = (int)((p0.x + 1.f) * width / 2);
-	int x1 = (int)((p1.x + 1.f) * width / 2);
-	int y0 = (int)((1.f - p0.y) * height / 2);
-	int y1 = (int)((1.f - p1.y) * height / 2);
+	auto fb = get_surface();
+	int x0 = (int)((p0.x + 1.f) * fb.width / 2);
+	int x1 = (int)((p1.x + 1.f) * fb.width / 2);
+	int y0 = (int)((1.f - p0.y) * fb.height / 2);
+	int y1 = (int)((1.f - p1.y) * fb.height / 2);
 
 	line(x0, y0, x1, y1, color);
 }
 
-extern mat4x4f_t model_view;
-extern mat4x4f_t viewport;
-extern mat4x4f_t projection;
-void render::line(vec3f_t p0, vec3f_t p1, uint32_t color)
+/* Clip a segment to the rectangle [0, xmax] x [0, ymax] (Liang-Barsky).
+ * Return false if nothing is left.
+ */
+static bool clip(vec4f_t& p0, vec4f_t& p1, float xmax, float ymax)
 {
-	auto v0{ project_to_screen(p0) };
-	auto v1{ project_to_screen(p1) };
+	float t0 = 0.f;
+	float t1 = 1.f;
+	float dx = p1.x - p0.x;
+	float dy = p1.y - p0.y;
+
+	/* p: direction towards the boundary, q: distance to it */
+	const float p[4] = { -dx, dx, -dy, dy };
+	const float q[4] = { p0.x, xmax - p0.x, p0.y, ymax - p0.y };
+	for (size_t i = 0; i < 4; i++) {
+		if (p[i] == 0) {
+			if (q[i] < 0)
+				return false;
+			continue;
+		}
+
+		float t = q[i] / p[i];
+		if (p[i] < 0) {
+			if (t > t1)
+				return false;
+			t0 = std::max(t0, t);
+		} else {
+			if (t < t0)
+				return false;
+			t1 = std::min(t1, t);
+		}
+	}
 
+	vec4f_t d = p1 - p0;
+	if (t1 < 1.f)
+		p1 = p0 + d * t1;
+	if (t0 > 0.f)
+		p0 = p0 + d * t0;
+	return true;
+}
+
+/* Clip a segment in homogeneous coordinates to w >= near_w, the near plane.
+ * Return false if nothing is left.
+ */
+static bool clip_near(vec4f_t& p0, vec4f_t& p1, float near_w)
+{
+	if (p0.w < near_w && p1.w < near_w)
+		return false;
+
+	if (p0.w < near_w)
+		p0 = p0 + (p1 - p0) * ((near_w - p0.w) / (p1.w - p0.w));
+	else if (p1.w < near_w)
+		p1 = p1 + (p0 - p1) * ((near_w - p1.w) / (p0.w - p1.w));
+	return true;
+}
+
+static void perspective_divide(vec4f_t& p)
+{
+	float inv_w = 1.f / p.w;
+	p.x *= inv_w;
+	p.y *= inv_w;
+	p.z *= inv_w;
+}
+
+/* Draw a line in homogeneous screen coordinates with depth. The line is
+ * clipped to the near plane, then to the surface. With MSAA a line covers all
+ * samples of its pixels.
+ */
+template <bool DEPTH_TEST, bool MSAA>
+static void draw_clipped(vec4f_t v0, vec4f_t v1, float near_w, uint32_t color,
+	const display::surface_t& fb, const render::zbuf::surface_t& zb,
+	const render::msaa::surface_t& ms)
+{
+	if (!clip_near(v0, v1, near_w))
+		return;
+	perspective_divide(v0);
+	perspective_divide(v1);
+	if (!clip(v0, v1, fb.width - 1.f, fb.height - 1.f))
+		return;
+
+	/* clipped coordinates are within the surface, no more checks below */
 	bool steep = false;
 	if (std::abs(v0.x - v1.x) < std::abs(v0.y - v1.y)) {
-		std::swap(v0[0], v0[1]);
-		std::swap(v1[0], v1[1]);
+		std::swap(v0.x, v0.y);
+		std::swap(v1.x, v1.y);
 		steep = true;
 	}
 
 	if (v0.x > v1.x)
 		std::swap(v0, v1);
 
-	int dx = (int)(v1.x - v0.x);
-	int dy = (int)(v1.y - v0.y);
+	int x0 = (int)v0.x, x1 = (int)v1.x;
+	int dx = x1 - x0;
+	int dy = (int)v1.y - (int)v0.y;
 	int y_dir = dy > 0 ? 1 : -1;
 
 	int derr = std::abs(dy) * 2;
@@ -78,13 +184,17 @@ void render::line(vec3f_t p0, vec3f_t p1, uint32_t color)
 
 	float z_step = (v1.z - v0.z) / (dx + 1);
 	float z = v0.z;
-	for (int x = (int)v0.x, y = (int)v0.y; x <= v1.x; x++, z += z_step) {
-		if (steep) {
-			if (zbuf::put(y, x, z))
-				display::put(y, x, color);
-		} else {
-			if (zbuf::put(x, y, z))
-				display::put(x, y, color);
+	for (int x = x0, y = (int)v0.y; x <= x1; x++, z += z_step) {
+		int px = steep ? y : x;
+		int py = steep ? x : y;
+
+		if constexpr (MSAA) {
+			if (DEPTH_TEST)
+				ms.put(px, py, z, color);
+			else
+				ms.put(px, py, render::msaa::FULL_COVERAGE, color);
+		} else if (!DEPTH_TEST || zb.put(px, py, z)) {
+			fb.put(px, py, color);
 		}
 
 		err += derr;
@@ -94,3 +204,156 @@ void render::line(vec3f_t p0, vec3f_t p1, uint32_t color)
 		}
 	}
 }
+
+template <bool DEPTH_TEST, bool MSAA>
+static void draw_lines(const vec4f_t *v, const unsigned *idx, size_t n, float near_w, uint32_t color)
+{
+	auto fb = render::get_surface();
+	auto zb = render::zbuf::get_surface();
+	render::msaa::surface_t ms{};
+	if constexpr (MSAA)
+		ms = render::msaa::get_surface();
+
+	for (size_t i = 0; i < n; i++)
+		draw_clipped<DEPTH_TEST, MSAA>(v[idx[2 * i]], v[idx[2 * i + 1]], near_w, color, fb, zb, ms);
+}
+
+static void draw_lines(const vec4f_t *v, const unsigned *idx, size_t n, float near_w, uint32_t color,
+	bool depth_test, bool msaa)
+{
+	if (msaa) {
+		if (depth_test)
+			draw_lines<true, true>(v, idx, n, near_w, color);
+		else
+			draw_lines<false, true>(v, idx, n, near_w, color);
+	} else {
+		if (depth_test)
+			draw_lines<true, false>(v, idx, n, near_w, color);
+		else
+			draw_lines<false, false>(v, idx, n, near_w, color);
+	}
+}
+
+/* Homogeneous lines recorded to a frame packet */
+struct lines_draw_t : render::frame::draw_t {
+	/* allocated from the frame arena */
+	const vec4f_t *screen;
+	const unsigned *idx;
+	size_t n;
+	float near_w;
+	uint32_t color;
+	bool depth_test;
+	bool msaa;
+
+	void raster(void) override
+	{
+		draw_lines(screen, idx, n, near_w, color, depth_test, msaa);
+	}
+};
+
+/* Draw lines between homogeneous vertices. idx holds n pairs of indices */
+static void draw_lines(const vec4f_t *v, const unsigned *idx, size_t n, uint32_t color)
+{
+	if (render::is_pipelining_enabled()) {
+		auto& arena = render::frame::get_memory().frame;
+		auto draw = render::frame::create<lines_draw_t>();
+		/* only referenced vertices are needed, but the copy is cheaper than
+		 * remapping indices
+		 */
+		size_t count = 0;
+		for (size_t i = 0; i < 2 * n; i++)
+			count = std::max(count, (size_t)idx[i] + 1);
+		vec4f_t *s = arena.alloc_array<vec4f_t>(count);
+		unsigned *e = arena.alloc_array<unsigned>(2 * n);
+		std::copy(v, v + count, s);
+		std::copy(idx, idx + 2 * n, e);
+		draw->screen = s;
+		draw->idx = e;
+		draw->n = n;
+		draw->near_w = render::get_near_w();
+		draw->color = color;
+		draw->depth_test = render::is_zbuf_enabled();
+		draw->msaa = render::is_msaa_enabled();
+		render::frame::record(draw);
+		return;
+	}
+
+	draw_lines(v, idx, n, render::get_near_w(), color, render::is_zbuf_enabled(),
+		render::is_msaa_enabled());
+}
+
+/* Projected vertices, reused between calls to avoid allocations per frame */
+static std::vector<vec4f_t> screen;
+
+/* Vertices and unique edges of the last wireframe mesh. Rebuilt only when
+ * another mesh is drawn or the mesh has grown (streamed models).
+ */
+static struct {
+	const void *faces;
+	size_t face_count;
+	const void *vertices;
+	size_t vertex_count;
+	std::vector<vec3f_t> positions;
+	std::vector<unsigned> edges;
+} mesh;
+
+void render::line(vec3f_t p0, vec3f_t p1, uint32_t color)
+{
+	PROFILE_ZONE("render::line");
+	const vec3f_t v[2] = { p0, p1 };
+	const unsigned idx[2] = { 0, 1 };
+	vec4f_t s[2];
+
+	project_homogeneous(v, s, 2);
+	draw_lines(s, idx, 1, color);
+}
+
+void render::line(const std::vector<vec3f_t>& vertices, const std::vector<unsigned>& indices, uint32_t color)
+{
+	PROFILE_ZONE("render::line");
+	screen.resize(vertices.size());
+	project_homogeneous(vertices.data(), screen.data(), vertices.size());
+	draw_lines(screen.data(), indices.data(), indices.size() / 2, color);
+}
+
+void render::wireframe(const std::vector<::model_t::Face>& faces,
+	const std::vector<std::vector<float>>& vertices, uint32_t color)
+{
+	if (mesh.vertices != vertices.data() || mesh.vertex_count != vertices.size()) {
+		mesh.vertices = vertices.data();
+		mesh.vertex_count = vertices.size();
+		mesh.positions.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+			mesh.positions[i] = { vertices[i][0], vertices[i][1], vertices[i][2] };
+	}
+
+	if (mesh.faces != faces.data() || mesh.face_count != faces.size()) {
+		mesh.faces = faces.data();
+		mesh.face_count = faces.size();
+
+		/* an edge shared by two faces is drawn once: keep edges as
+		 * (lower, higher) index pairs, sort and drop duplicates
+		 */
+		std::vector<std::pair<unsigned, unsigned>> pairs(faces.size() * 3);
+		for (size_t i = 0; i < faces.size(); i++) {
+			const auto& face = faces[i];
+
+			/* OBJ indices are 1-based */
+			for (size_t j = 0; j < 3; j++) {
+				unsigned a = (unsigned)face.v_idx[j] - 1;
+				unsigned b = (unsigned)face.v_idx[(j + 1) % 3] - 1;
+				pairs[i * 3 + j] = std::minmax(a, b);
+			}
+		}
+		std::sort(pairs.begin(), pairs.end());
+		pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+		mesh.edges.resize(pairs.size() * 2);
+		for (size_t i = 0; i < pairs.size(); i++) {
+			mesh.edges[2 * i] = pairs[i].first;
+			mesh.edges[2 * i + 1] = pairs[i].second;
+		}
+	}
+
+	line(mesh.positions, mesh.edges, color);
+}
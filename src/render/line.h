@@ -2,6 +2,8 @@
 #define RENDER_LINE_H_
 
 #include <cstdint>
+#include <vector>
+#include <model/model.h>
 #include <vector.h>
 
 namespace render {
@@ -32,6 +34,31 @@ void line(vec2f_t p0, vec2f_t p1, uint32_t color);
  */
 void line(vec3f_t p0, vec3f_t p1, uint32_t color);
 
+/** Draw lines in model coordinates
+ * Vertices are projected once and shared by all the lines. Lines are clipped
+ * to the near plane and the viewport before rasterization, so off-screen
+ * parts cost nothing and lines behind the camera are cut, not dropped.
+ *
+ * @param vertices: an array of vertices.
+ * @param indices: pairs of vertex indices, a pair per line.
+ * @param color: the lines color in RGB888 format
+ */
+void line(const std::vector<vec3f_t>& vertices, const std::vector<unsigned>& indices, uint32_t color);
+
+/** Draw model edges
+ * Vertices are projected once and shared by all the edges. An edge shared by
+ * faces is drawn once. The edge list is built on the first call for a mesh
+ * and reused while the same arrays are drawn.
+ *
+ * @param faces: an array of faces.
+ * @param vertices: an array of vertex coordinates.
+ * @param color: the lines color in RGB888 format
+ *
+ * @note The function doesn't check if input arrays are valid.
+ */
+void wireframe(const std::vector<::model_t::Face>& faces,
+	const std::vector<std::vector<float>>& vertices, uint32_t color);
+
 } /* namespace render */
 
 #endif /* RENDER_LINE_H_ */
@@ -0,0 +1,102 @@
+#include "msaa.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <jobs/jobs.h>
+#include <render/render.h>
+
+static int width;
+static int height;
+static int tiles_x;
+static int tiles_y;
+
+static std::vector<float> depth_samples;
+static std::vector<uint32_t> color_samples;
+static std::vector<uint8_t> expanded;
+
+/* Samples cleared by a job */
+constexpr size_t CLEAR_GRAIN = 1 << 16;
+
+int render::msaa::init(int w, int h)
+{
+	if (w <= 0 || h <= 0)
+		return 1;
+
+	width = w;
+	height = h;
+	tiles_x = (w + TILE - 1) / TILE;
+	tiles_y = (h + TILE - 1) / TILE;
+
+	depth_samples.resize(display::tile_size(w, h) * SAMPLES);
+	color_samples.resize(display::tile_size(w, h) * SAMPLES);
+	expanded.assign((size_t)tiles_x * tiles_y, 0);
+	return 0;
+}
+
+void render::msaa::release(void)
+{
+	depth_samples.resize(0);
+	depth_samples.shrink_to_fit();
+	color_samples.resize(0);
+	color_samples.shrink_to_fit();
+	expanded.resize(0);
+	width = height = tiles_x = tiles_y = 0;
+}
+
+void render::msaa::clear(void)
+{
+	jobs::parallel_for(depth_samples.size(), CLEAR_GRAIN, [](size_t begin, size_t end) {
+		std::fill(depth_samples.begin() + begin, depth_samples.begin() + end,
+			std::numeric_limits<float>::lowest());
+	});
+	std::fill(expanded.begin(), expanded.end(), 0);
+}
+
+render::msaa::surface_t render::msaa::get_surface(void)
+{
+	return { depth_samples.data(), color_samples.data(), expanded.data(),
+		render::get_surface().pixels, width, height, tiles_x };
+}
+
+void render::msaa::surface_t::expand(size_t tile) const
+{
+	const size_t first = tile * TILE * TILE;
+
+	for (size_t i = first; i < first + TILE * TILE; i++) {
+		uint32_t *samples = color_samples + i * SAMPLES;
+		for (int s = 0; s < SAMPLES; s++)
+			samples[s] = pixels[i];
+	}
+	expanded[tile] = 1;
+}
+
+/* Average 4 samples. Red and blue are summed in one register: 4 * 255 fits
+ * in the 8 spare bits between them.
+ */
+static uint32_t average(const uint32_t *s)
+{
+	static_assert(render::msaa::SAMPLES == 4);
+
+	uint32_t rb = (s[0] & 0xFF00FF) + (s[1] & 0xFF00FF) + (s[2] & 0xFF00FF) + (s[3] & 0xFF00FF);
+	uint32_t g = (s[0] & 0x00FF00) + (s[1] & 0x00FF00) + (s[2] & 0x00FF00) + (s[3] & 0x00FF00);
+
+	return (uint32_t)0xFF000000 | ((rb >> 2) & 0xFF00FF) | ((g >> 2) & 0x00FF00);
+}
+
+void render::msaa::resolve(void)
+{
+	uint32_t *pixels = render::get_surface().pixels;
+
+	/* a row of tiles per job */
+	jobs::parallel_for(tiles_y, 1, [pixels](size_t begin, size_t end) {
+		for (size_t tile = begin * tiles_x; tile < end * tiles_x; tile++) {
+			/* compressed tiles are resolved already */
+			if (!expanded[tile])
+				continue;
+
+			const size_t first = tile * TILE * TILE;
+			for (size_t i = first; i < first + TILE * TILE; i++)
+				pixels[i] = average(&color_samples[i * SAMPLES]);
+		}
+	});
+}
@@ -0,0 +1,131 @@
+#ifndef RENDER_MSAA_H_
+#define RENDER_MSAA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <display/display.h>
+
+namespace render::msaa {
+
+/* Number of samples per pixel */
+constexpr int SAMPLES = 4;
+constexpr unsigned FULL_COVERAGE = (1u << SAMPLES) - 1;
+
+/* Sample positions relative to a pixel center (rotated grid) */
+constexpr float OFFSETS[SAMPLES][2] = {
+	{ -0.125f, -0.375f },
+	{  0.375f, -0.125f },
+	{ -0.375f,  0.125f },
+	{  0.125f,  0.375f },
+};
+
+/* Color samples are compressed per tile of TILE x TILE pixels. A compressed
+ * tile keeps one color per pixel right in the color buffer. A tile is
+ * expanded to SAMPLES colors per pixel only when a pixel of it is partially
+ * covered, so interiors of triangles cost no more than without MSAA.
+ * Samples are stored in the order of pixels of the color buffer, a tile of
+ * the buffer is a compression tile: pixels and samples of a tile are
+ * contiguous.
+ */
+constexpr int TILE = display::TILE;
+
+/** Initialize sample buffers
+ *
+ * @param w: buffer width (in screen coordinates).
+ * @param h: buffer height (in screen coordinates).
+ * @return 0 on success.
+ */
+int init(int w, int h);
+
+/** Release sample buffers.
+ *
+ * @note It's safe to invoke the function if init() failed or has never been
+ * invoked.
+ */
+void release(void);
+
+/** Clear depth samples and compress all tiles
+ * Color of compressed tiles is the color buffer, so clear it by
+ * render::clear().
+ */
+void clear(void);
+
+/** Resolve expanded tiles to the color buffer */
+void resolve(void);
+
+/** Direct sample buffers access
+ * No bounds checks: callers clip coordinates to the buffer size themselves.
+ */
+struct surface_t {
+	float *depth_samples;
+	uint32_t *color_samples;
+	uint8_t *expanded; /**< per tile flag */
+	uint32_t *pixels;  /**< color buffer, see render::get_surface() */
+	int width;
+	int height;
+	int tiles_x;
+
+	/** Get offset of a pixel in the color buffer */
+	size_t index(int x, int y) const
+	{
+		return display::tile_row(y, width) + display::tile_column(x);
+	}
+
+	/** Get depth samples of a pixel */
+	float *depth(int x, int y) const
+	{
+		return depth_samples + index(x, y) * SAMPLES;
+	}
+
+	/** Write color to samples of a pixel selected by mask */
+	void put(int x, int y, unsigned mask, uint32_t color) const
+	{
+		size_t i = index(x, y);
+		size_t tile = i / (TILE * TILE);
+
+		color |= (uint32_t)0xFF000000;
+		if (!expanded[tile]) {
+			if (mask == FULL_COVERAGE) {
+				pixels[i] = color;
+				return;
+			}
+			expand(tile);
+		}
+
+		uint32_t *samples = color_samples + i * SAMPLES;
+		for (int s = 0; s < SAMPLES; s++) {
+			if (mask & (1u << s))
+				samples[s] = color;
+		}
+	}
+
+	/** Depth test all samples of a pixel against z, store z and color in
+	 * passed ones
+	 */
+	void put(int x, int y, float z, uint32_t color) const
+	{
+		float *d = depth(x, y);
+		unsigned mask = 0;
+
+		for (int s = 0; s < SAMPLES; s++) {
+			if (z > d[s]) {
+				d[s] = z;
+				mask |= 1u << s;
+			}
+		}
+		if (mask)
+			put(x, y, mask, color);
+	}
+
+	/** Copy pixel colors of a compressed tile to its samples */
+	void expand(size_t tile) const;
+};
+
+/** Get sample buffers surface
+ * The surface is valid until release() or next init() call.
+ */
+surface_t get_surface(void);
+
+} /* namespace render::msaa */
+
+#endif /* RENDER_MSAA_H_ */
@@ -0,0 +1,1078 @@
+#ifndef RENDER_PIPELINE_H_
+#define RENDER_PIPELINE_H_
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <display/display.h>
+#include <jobs/jobs.h>
+#include <profile/profile.h>
+#include <render/frame.h>
+#include <render/msaa.h>
+#include <render/quad.h>
+#include <render/render.h>
+#include <render/zbuf.h>
+#include <vector.h>
+
+namespace render {
+
+/** Shader interface
+ * A shader is a class which declares its varyings layout and provides vertex
+ * and fragment functions:
+ *
+ *   struct my_shader {
+ *           using varyings_t = ...;
+ *           vec4f_t vertex(const Vertex& in, varyings_t& out) const;
+ *           bool fragment(const varyings_t& in, uint32_t& color) const;
+ *   };
+ *
+ * vertex() returns homogeneous screen coordinates of the vertex (see
+ * project_homogeneous()) and fills the varyings to be interpolated across the
+ * triangle. Varyings are interpolated as v0 * w0 + v1 * w1 + v2 * w2, so
+ * varyings_t has to provide operator+ and operator* by a scalar (vec_t does).
+ *
+ * fragment() calculates a pixel color in RGB888 format from interpolated
+ * varyings. Returning false discards the fragment.
+ *
+ * Pixels are shaded in 2x2 quads. A shader which needs derivatives of
+ * varyings, e.g. to select a texture mip level, declares fragment() of a
+ * quad instead (see quad_t): in.in() are varyings of the pixel, in.ddx() and
+ * in.ddy() their change to the neighbors in the quad.
+ *
+ *   bool fragment(const quad_t<varyings_t>& in, uint32_t& color) const;
+ *
+ * The rasterizer is a template instantiated around the shader, so both
+ * functions are inlined into the quad loop. Both are called from job threads
+ * and, with pipelining, after the draw call returned: a shader keeps copies
+ * of its uniforms (e.g. get_mvp()) rather than reading the render state.
+ */
+template <typename S>
+concept quad_shader = requires(const S& s, const quad_t<typename S::varyings_t>& quad, uint32_t& color) {
+	{ s.fragment(quad, color) } -> std::convertible_to<bool>;
+};
+
+template <typename S>
+concept shader = std::default_initializable<typename S::varyings_t> &&
+	requires(const S& s, const Vertex& in, typename S::varyings_t& out,
+		const typename S::varyings_t& var) {
+	{ s.vertex(in, out) } -> std::same_as<vec4f_t>;
+	{ var * 1.f + var } -> std::convertible_to<typename S::varyings_t>;
+} && (quad_shader<S> || requires(const S& s, const typename S::varyings_t& var, uint32_t& color) {
+	{ s.fragment(var, color) } -> std::convertible_to<bool>;
+});
+
+/** Depth-only shader
+ * The fast path for shadow maps and depth prepasses: a shader which declares
+ * depth_only renders to its own depth target. There is no color buffer and
+ * no fragment stage, fragment() is never called and the varyings should be
+ * empty. MSAA is ignored, depth test and write are always on and coverage is
+ * calculated by the fixed point rasterizer, the cheapest one per pixel.
+ *
+ *   struct my_depth_shader {
+ *           static constexpr bool depth_only = true;
+ *           zbuf::surface_t target;
+ *           ...
+ *   };
+ */
+template <typename S>
+concept depth_only_shader = shader<S> && S::depth_only &&
+	requires(const S& s) {
+	{ s.target } -> std::convertible_to<zbuf::surface_t>;
+};
+
+namespace pipeline {
+
+/* Fixed function state bits. A rasterizer is instantiated for every
+ * combination of them, the state is tested by "if constexpr" only. A new state
+ * costs one more bit here and doesn't add a single instruction to existing
+ * specializations.
+ */
+enum : unsigned {
+	DEPTH_TEST   = 1 << 0,
+	DEPTH_WRITE  = 1 << 1,
+	FIXED_POINT  = 1 << 2,
+	MSAA         = 1 << 3,
+	FORMAT_SHIFT = 4, /* zbuf::format, 4 values */
+	FORMAT_MASK  = 3 << FORMAT_SHIFT,
+	CULL_SHIFT   = 6, /* render::cull_mode, 3 values */
+	STATE_COUNT  = 3 << CULL_SHIFT,
+};
+
+/** Collect current fixed function state */
+unsigned get_state(void);
+
+/** Get fixed function state to draw with a shader */
+template <shader S>
+unsigned get_state(const S& shader)
+{
+	if constexpr (depth_only_shader<S>) {
+		unsigned state = get_state() & ~(unsigned)(MSAA | FORMAT_MASK);
+		state |= static_cast<unsigned>(zbuf::surface_t(shader.target).fmt) << FORMAT_SHIFT;
+		return state | DEPTH_TEST | DEPTH_WRITE | FIXED_POINT;
+	} else {
+		return get_state();
+	}
+}
+
+/* Get depth format of a state */
+constexpr zbuf::format get_format(unsigned state)
+{
+	return static_cast<zbuf::format>((state & FORMAT_MASK) >> FORMAT_SHIFT);
+}
+
+/* Check if a state accesses the depth buffer rather than MSAA samples */
+constexpr bool uses_zbuf(unsigned state)
+{
+	return (state & (DEPTH_TEST | DEPTH_WRITE)) && !(state & MSAA);
+}
+
+/* States rasterized the same way share a specialization: reversed-Z is
+ * stored as float32, the format doesn't matter if the depth buffer isn't
+ * used. Depth-only shaders have their state forced by get_state().
+ */
+template <shader S>
+constexpr unsigned canonical_state(unsigned state)
+{
+	if constexpr (depth_only_shader<S>)
+		state = (state & ~(unsigned)MSAA) | DEPTH_TEST | DEPTH_WRITE | FIXED_POINT;
+
+	zbuf::format fmt = get_format(state);
+	if (fmt == zbuf::format::reversed_float32 || !uses_zbuf(state))
+		fmt = zbuf::format::float32;
+
+	return (state & ~(unsigned)FORMAT_MASK) | static_cast<unsigned>(fmt) << FORMAT_SHIFT;
+}
+
+/* Surfaces to render to: the current ones or the target of a depth-only
+ * shader
+ */
+struct surfaces_t {
+	display::surface_t fb;
+	zbuf::surface_t zb;
+	msaa::surface_t ms;
+};
+
+template <shader S>
+surfaces_t get_surfaces(const S& shader, unsigned state)
+{
+	if constexpr (depth_only_shader<S>) {
+		return { {}, shader.target, {} };
+	} else {
+		surfaces_t s{ render::get_surface(), zbuf::get_surface(), {} };
+		if (state & MSAA)
+			s.ms = msaa::get_surface();
+		return s;
+	}
+}
+
+/* Fixed point rasterizer precision: 24.8 screen coordinates */
+constexpr int SUBPIXEL_BITS = 8;
+constexpr int64_t SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+constexpr int64_t SUBPIXEL_HALF = SUBPIXEL_ONE / 2;
+
+/* Guard band in pixels. Triangles within [-GUARD_BAND, GUARD_BAND] are
+ * rasterized without clipping: only the bounding box is clamped to the
+ * viewport. The range keeps edge function products well within 64 bits.
+ */
+constexpr float GUARD_BAND = 1 << 13;
+
+/* return signed area of the triangle ABP multiplied by 2.
+ * if point p at the right hand side of AB the result is positive. If the point
+ * exactly on the line - 0, otherwise - negative.
+ */
+inline float edge_function(const vec3f_t& a, const vec3f_t& b, const vec3f_t& p)
+{
+	return (a.x - b.x) * (p.y - a.y) - (a.y - b.y) * (p.x - a.x);
+}
+
+/* check if edge function is positive, if the point is on the edge, check if it
+ * is a top or left edge
+ */
+inline bool is_inside(float w, const vec3f_t& edge)
+{
+	return !(w < 0 || (w == 0 && ((edge.y == 0 && edge.x <= 0) || edge.y < 0)));
+}
+
+/* Check if a triangle is discarded by its doubled signed area */
+template <cull_mode CULL, typename T>
+inline bool is_culled(T area)
+{
+	if (area == 0)
+		return true;
+	if constexpr (CULL == cull_mode::back)
+		return area < 0;
+	else if constexpr (CULL == cull_mode::front)
+		return area > 0;
+	else
+		return false;
+}
+
+/* Clipping rectangle, inclusive */
+struct rect_t {
+	int x0, y0;
+	int x1, y1;
+};
+
+/* Clamp a triangle bounding box to a clipping rectangle. Return false if
+ * nothing left
+ */
+inline bool clamp_bbox(vec2i_t& bbox_min, vec2i_t& bbox_max, const rect_t& clip)
+{
+	bbox_min.x = std::max(bbox_min.x, clip.x0);
+	bbox_min.y = std::max(bbox_min.y, clip.y0);
+	bbox_max.x = std::min(bbox_max.x, clip.x1);
+	bbox_max.y = std::min(bbox_max.y, clip.y1);
+
+	return bbox_min.x <= bbox_max.x && bbox_min.y <= bbox_max.y;
+}
+
+/* Run the fragment stage for lanes of a quad. w[k] are normalized
+ * barycentric coordinates of the lanes to shade at. A quad shader gets
+ * varyings of all lanes for derivatives, others only of the shaded ones.
+ * Return the lanes which aren't discarded.
+ */
+template <shader S>
+inline unsigned fragment_quad(const S& shader, unsigned mask, const float4_t w[3],
+	const typename S::varyings_t var[3], uint32_t color[QUAD_LANES])
+{
+	float lw[3][QUAD_LANES];
+	for (int k = 0; k < 3; k++)
+		w[k].store(lw[k]);
+
+	if constexpr (quad_shader<S>) {
+		quad_t<typename S::varyings_t> quad;
+		for (int l = 0; l < QUAD_LANES; l++)
+			quad.var[l] = var[0] * lw[0][l] + var[1] * lw[1][l] + var[2] * lw[2][l];
+
+		for (quad.lane = 0; quad.lane < QUAD_LANES; quad.lane++) {
+			if ((mask & (1u << quad.lane)) && !shader.fragment(quad, color[quad.lane]))
+				mask &= ~(1u << quad.lane);
+		}
+	} else {
+		for (int l = 0; l < QUAD_LANES; l++) {
+			if (!(mask & (1u << l)))
+				continue;
+			if (!shader.fragment(var[0] * lw[0][l] + var[1] * lw[1][l] + var[2] * lw[2][l], color[l]))
+				mask &= ~(1u << l);
+		}
+	}
+
+	return mask;
+}
+
+/* Depth test, shade and write covered pixels of a quad.
+ * w[k] are normalized barycentric coordinates of the lanes, mask tells the
+ * covered ones. Rows are clipped once per triangle, so there are no bounds
+ * checks here: rows of lanes which aren't covered may be nullptr. Depth and
+ * color rows are tiled the same way, a pixel has the same column offset in
+ * both, and a quad never crosses a tile.
+ */
+template <shader S, unsigned STATE>
+inline void shade_quad(const S& shader, int x, unsigned mask, const float4_t w[3],
+	const vec3f_t& p0, const vec3f_t& p1, const vec3f_t& p2,
+	const typename S::varyings_t var[3], void *const depth_rows[2], uint32_t *const color_rows[2])
+{
+	using depth = zbuf::traits<get_format(STATE)>;
+	const size_t i = display::tile_column(x);
+
+	/* depth test */
+	float z[QUAD_LANES];
+	(w[0] * float4_t(p0.z) + w[1] * float4_t(p1.z) + w[2] * float4_t(p2.z)).store(z);
+	typename depth::key_t keys[QUAD_LANES];
+	for (int l = 0; l < QUAD_LANES; l++) {
+		if (!(mask & (1u << l)))
+			continue;
+		keys[l] = depth::key(z[l]);
+		if constexpr (STATE & DEPTH_TEST) {
+			if (!(keys[l] > depth::load(depth_rows[l >> 1], i + (l & 1))))
+				mask &= ~(1u << l);
+		}
+	}
+	if (!mask)
+		return;
+
+	if constexpr (depth_only_shader<S>) {
+		for (int l = 0; l < QUAD_LANES; l++) {
+			if (mask & (1u << l))
+				depth::store(depth_rows[l >> 1], i + (l & 1), keys[l]);
+		}
+		return;
+	}
+
+	/* fragment stage */
+	uint32_t color[QUAD_LANES];
+	mask = fragment_quad(shader, mask, w, var, color);
+
+	for (int l = 0; l < QUAD_LANES; l++) {
+		if (!(mask & (1u << l)))
+			continue;
+		if constexpr (STATE & DEPTH_WRITE)
+			depth::store(depth_rows[l >> 1], i + (l & 1), keys[l]);
+		color_rows[l >> 1][i + (l & 1)] = (uint32_t)0xFF000000 | color[l];
+	}
+}
+
+/* Depth test covered samples of a quad, shade each pixel once and write the
+ * passed samples. coverage[l] are samples of lane l inside the triangle,
+ * w[l][k][s] are normalized barycentric coordinates of sample s of the lane.
+ */
+template <shader S, unsigned STATE>
+inline void shade_msaa_quad(const S& shader, int x, int y, const unsigned coverage[QUAD_LANES],
+	const float w[QUAD_LANES][3][msaa::SAMPLES],
+	const vec3f_t& p0, const vec3f_t& p1, const vec3f_t& p2,
+	const typename S::varyings_t var[3], const msaa::surface_t& ms)
+{
+	float z[QUAD_LANES][msaa::SAMPLES];
+	unsigned mask[QUAD_LANES] = {};
+	unsigned live = 0;
+	/* barycentric coordinates to shade lanes at */
+	float c[3][QUAD_LANES];
+
+	for (int l = 0; l < QUAD_LANES; l++) {
+		/* depth test */
+		if (coverage[l]) {
+			const float *depth = ms.depth(x + (l & 1), y + (l >> 1));
+			for (int s = 0; s < msaa::SAMPLES; s++) {
+				if (!(coverage[l] & (1u << s)))
+					continue;
+				z[l][s] = w[l][0][s] * p0.z + w[l][1][s] * p1.z + w[l][2][s] * p2.z;
+				if constexpr (STATE & DEPTH_TEST) {
+					if (!(z[l][s] > depth[s]))
+						continue;
+				}
+				mask[l] |= 1u << s;
+			}
+			if (mask[l])
+				live |= 1u << l;
+		}
+
+		/* Shade at the pixel center (sample offsets sum up to zero) if it's
+		 * fully covered or a helper lane. Otherwise the center may be
+		 * outside of the triangle, take the first covered sample.
+		 */
+		if (coverage[l] == msaa::FULL_COVERAGE || !coverage[l]) {
+			for (int k = 0; k < 3; k++)
+				c[k][l] = (w[l][k][0] + w[l][k][1] + w[l][k][2] + w[l][k][3]) * 0.25f;
+		} else {
+			int s = std::countr_zero(coverage[l]);
+			for (int k = 0; k < 3; k++)
+				c[k][l] = w[l][k][s];
+		}
+	}
+	if (!live)
+		return;
+
+	/* fragment stage */
+	const float4_t cw[3] = {
+		{ c[0][0], c[0][1], c[0][2], c[0][3] },
+		{ c[1][0], c[1][1], c[1][2], c[1][3] },
+		{ c[2][0], c[2][1], c[2][2], c[2][3] },
+	};
+	uint32_t color[QUAD_LANES];
+	live = fragment_quad(shader, live, cw, var, color);
+
+	for (int l = 0; l < QUAD_LANES; l++) {
+		if (!(live & (1u << l)))
+			continue;
+		if constexpr (STATE & DEPTH_WRITE) {
+			float *depth = ms.depth(x + (l & 1), y + (l >> 1));
+			for (int s = 0; s < msaa::SAMPLES; s++) {
+				if (mask[l] & (1u << s))
+					depth[s] = z[l][s];
+			}
+		}
+		ms.put(x + (l & 1), y + (l >> 1), mask[l], color[l]);
+	}
+}
+
+/* Bounds of quads of a triangle: the bounding box aligned down to even
+ * coordinates, lanes outside of the box are never covered.
+ */
+struct quad_bounds_t {
+	vec2i_t min;
+	vec2i_t max;
+
+	quad_bounds_t(const vec2i_t& bbox_min, const vec2i_t& bbox_max)
+		: min{ bbox_min.x & ~1, bbox_min.y & ~1 }, max(bbox_max), first_x(bbox_min.x), first_y(bbox_min.y)
+	{
+	}
+
+	/* lanes of a quad row in the box */
+	unsigned rows(int y) const
+	{
+		return (y >= first_y ? QUAD_FULL : 0xCu) & (y + 1 <= max.y ? QUAD_FULL : 0x3u);
+	}
+
+	/* lanes of a quad in the box */
+	unsigned lanes(unsigned rows, int x) const
+	{
+		return rows & (x >= first_x ? QUAD_FULL : 0xAu) & (x + 1 <= max.x ? QUAD_FULL : 0x5u);
+	}
+
+	/* get rows of a quad row to draw to, nullptr out of the box */
+	template <shader S, unsigned STATE>
+	void get_rows(unsigned rows, int y, const display::surface_t& fb, const zbuf::surface_t& zb,
+		void *depth_rows[2], uint32_t *color_rows[2]) const
+	{
+		for (int r = 0; r < 2; r++) {
+			bool in = rows & (0x3u << 2 * r);
+			depth_rows[r] = in && uses_zbuf(STATE) ? zb.row<get_format(STATE)>(y + r) : nullptr;
+			color_rows[r] = in && !depth_only_shader<S> ? fb.row(y + r) : nullptr;
+		}
+	}
+
+private:
+	int first_x, first_y;
+};
+
+/* Early out of a quad row
+ * Pixel centers of a lane in a row, and positions of a sample of it, lie on
+ * a line: a convex triangle covers an interval of them. Once a lane (or a
+ * sample of a lane with MSAA) was covered and then isn't, the rest of its
+ * line is outside. Lines are tracked separately: with MSAA a row of pixels
+ * touched by a thin triangle may have gaps. The rest of the quad row is
+ * skipped when all lines are done.
+ */
+struct quad_span_t {
+	unsigned found = 0;
+	unsigned done;
+	unsigned all;
+
+	/* done: lines out of the bounding box, all: all lines */
+	quad_span_t(unsigned done, unsigned all) : done(done), all(all)
+	{
+	}
+
+	/* Add lines covered by the next quad, return true if the rest is
+	 * outside
+	 */
+	bool next(unsigned covered)
+	{
+		found |= covered;
+		done |= found & ~covered;
+		return done == all;
+	}
+};
+
+/* Lines of samples of covered lanes, see quad_span_t */
+inline unsigned sample_lines(const unsigned coverage[QUAD_LANES])
+{
+	unsigned lines = 0;
+	for (int l = 0; l < QUAD_LANES; l++)
+		lines |= coverage[l] << (l * msaa::SAMPLES);
+	return lines;
+}
+
+/* Lines of samples of lanes */
+inline unsigned sample_lines(unsigned lanes)
+{
+	const unsigned all[QUAD_LANES] = {
+		lanes & 1u ? msaa::FULL_COVERAGE : 0u,
+		lanes & 2u ? msaa::FULL_COVERAGE : 0u,
+		lanes & 4u ? msaa::FULL_COVERAGE : 0u,
+		lanes & 8u ? msaa::FULL_COVERAGE : 0u,
+	};
+	return sample_lines(all);
+}
+
+/* Start a quad row: lines of lanes, or of their samples with MSAA */
+template <unsigned STATE>
+quad_span_t start_span(unsigned rows)
+{
+	if constexpr (STATE & MSAA)
+		return quad_span_t(sample_lines(~rows & QUAD_FULL), sample_lines(QUAD_FULL));
+	else
+		return quad_span_t(~rows & QUAD_FULL, QUAD_FULL);
+}
+
+/* Rasterize a triangle with vertices snapped to fixed point.
+ * Edge functions are evaluated incrementally with integer arithmetic, which
+ * gives exact coverage: pixels on an edge shared by two triangles are drawn
+ * exactly once.
+ */
+template <shader S, unsigned STATE>
+void raster_fixed(const S& shader, vec3f_t p0, vec3f_t p1, vec3f_t p2,
+	typename S::varyings_t var[3], const rect_t& clip,
+	const display::surface_t& fb, const zbuf::surface_t& zb, const msaa::surface_t& ms)
+{
+	constexpr cull_mode CULL = static_cast<cull_mode>(STATE >> CULL_SHIFT);
+
+	int64_t x0 = std::llround(p0.x * SUBPIXEL_ONE), y0 = std::llround(p0.y * SUBPIXEL_ONE);
+	int64_t x1 = std::llround(p1.x * SUBPIXEL_ONE), y1 = std::llround(p1.y * SUBPIXEL_ONE);
+	int64_t x2 = std::llround(p2.x * SUBPIXEL_ONE), y2 = std::llround(p2.y * SUBPIXEL_ONE);
+
+	int64_t area = (x0 - x1) * (y2 - y0) - (y0 - y1) * (x2 - x0);
+	if (is_culled<CULL>(area))
+		return;
+
+	/* rasterize back faces as front ones with swapped vertices */
+	if constexpr (CULL != cull_mode::back) {
+		if (area < 0) {
+			std::swap(p1, p2);
+			std::swap(x1, x2);
+			std::swap(y1, y2);
+			std::swap(var[1], var[2]);
+			area = -area;
+		}
+	}
+
+	/* bounding box of pixel centers inside the triangle bounds, with MSAA
+	 * of pixels touched by the triangle
+	 */
+	vec2i_t bbox_min, bbox_max;
+	if constexpr (STATE & MSAA) {
+		bbox_min = { (int)(std::min({ x0, x1, x2 }) >> SUBPIXEL_BITS),
+			(int)(std::min({ y0, y1, y2 }) >> SUBPIXEL_BITS) };
+		bbox_max = { (int)(std::max({ x0, x1, x2 }) >> SUBPIXEL_BITS),
+			(int)(std::max({ y0, y1, y2 }) >> SUBPIXEL_BITS) };
+	} else {
+		bbox_min = {
+			(int)-((SUBPIXEL_HALF - std::min({ x0, x1, x2 })) >> SUBPIXEL_BITS),
+			(int)-((SUBPIXEL_HALF - std::min({ y0, y1, y2 })) >> SUBPIXEL_BITS) };
+		bbox_max = {
+			(int)((std::max({ x0, x1, x2 }) - SUBPIXEL_HALF) >> SUBPIXEL_BITS),
+			(int)((std::max({ y0, y1, y2 }) - SUBPIXEL_HALF) >> SUBPIXEL_BITS) };
+	}
+	if (!clamp_bbox(bbox_min, bbox_max, clip))
+		return;
+	const quad_bounds_t bounds(bbox_min, bbox_max);
+
+	/* Edge i is opposite to vertex i: e(p) = (a.x - b.x) * (p.y - a.y) -
+	 * (a.y - b.y) * (p.x - a.x). On-edge pixels belong to top and left
+	 * edges only, a bias of -1 for other edges turns e >= 0 test into e > 0.
+	 */
+	struct {
+		int64_t step_x, step_y, row, bias;
+		int64x4_t lane;                /* lane offsets from the quad origin */
+		int64_t sample[msaa::SAMPLES]; /* sample offsets from the center */
+	} e[3];
+	const int64_t ax[3] = { x1, x2, x0 }, ay[3] = { y1, y2, y0 };
+	const int64_t bx[3] = { x2, x0, x1 }, by[3] = { y2, y0, y1 };
+	const int64_t px = bounds.min.x * SUBPIXEL_ONE + SUBPIXEL_HALF;
+	const int64_t py = bounds.min.y * SUBPIXEL_ONE + SUBPIXEL_HALF;
+	for (size_t i = 0; i < 3; i++) {
+		int64_t dx = bx[i] - ax[i];
+		int64_t dy = by[i] - ay[i];
+		bool top_left = dy > 0 || (dy == 0 && dx > 0);
+
+		e[i].step_x = dy * SUBPIXEL_ONE;
+		e[i].step_y = -dx * SUBPIXEL_ONE;
+		e[i].bias = top_left ? 0 : -1;
+		e[i].row = (ax[i] - bx[i]) * (py - ay[i]) - (ay[i] - by[i]) * (px - ax[i]) + e[i].bias;
+		e[i].lane = int64x4_t(0, e[i].step_x, e[i].step_y, e[i].step_x + e[i].step_y);
+		for (int s = 0; s < msaa::SAMPLES; s++) {
+			int64_t ox = (int64_t)(msaa::OFFSETS[s][0] * SUBPIXEL_ONE);
+			int64_t oy = (int64_t)(msaa::OFFSETS[s][1] * SUBPIXEL_ONE);
+			e[i].sample[s] = ox * dy - oy * dx;
+		}
+	}
+
+	/* edge functions are stepped for the 4 lanes of a quad at once */
+	const float inv_area = 1.f / (float)area;
+	const int64x4_t quad_step[3] = {
+		int64x4_t(2 * e[0].step_x), int64x4_t(2 * e[1].step_x), int64x4_t(2 * e[2].step_x) };
+	const int64x4_t unbias[3] = { int64x4_t(-e[0].bias), int64x4_t(-e[1].bias), int64x4_t(-e[2].bias) };
+	for (int y = bounds.min.y; y <= bounds.max.y; y += 2) {
+		int64x4_t e0 = int64x4_t(e[0].row) + e[0].lane;
+		int64x4_t e1 = int64x4_t(e[1].row) + e[1].lane;
+		int64x4_t e2 = int64x4_t(e[2].row) + e[2].lane;
+		const unsigned rows = bounds.rows(y);
+		void *depth_rows[2];
+		uint32_t *color_rows[2];
+		bounds.get_rows<S, STATE>(rows, y, fb, zb, depth_rows, color_rows);
+		quad_span_t span = start_span<STATE>(rows);
+
+		for (int x = bounds.min.x; x <= bounds.max.x; x += 2) {
+			const unsigned lanes = bounds.lanes(rows, x);
+			unsigned covered = 0;
+			/* lines covered, see quad_span_t */
+			unsigned lines;
+
+			if constexpr (STATE & MSAA) {
+				float w[QUAD_LANES][3][msaa::SAMPLES];
+				unsigned coverage[QUAD_LANES] = {};
+				for (int s = 0; s < msaa::SAMPLES; s++) {
+					const int64x4_t s0 = e0 + int64x4_t(e[0].sample[s]);
+					const int64x4_t s1 = e1 + int64x4_t(e[1].sample[s]);
+					const int64x4_t s2 = e2 + int64x4_t(e[2].sample[s]);
+					const unsigned inside = ~(s0 | s1 | s2).lt_zero() & lanes;
+
+					float ws[3][QUAD_LANES];
+					((s0 + unbias[0]).to_float() * float4_t(inv_area)).store(ws[0]);
+					((s1 + unbias[1]).to_float() * float4_t(inv_area)).store(ws[1]);
+					((s2 + unbias[2]).to_float() * float4_t(inv_area)).store(ws[2]);
+					for (int l = 0; l < QUAD_LANES; l++) {
+						coverage[l] |= (inside >> l & 1u) << s;
+						w[l][0][s] = ws[0][l];
+						w[l][1][s] = ws[1][l];
+						w[l][2][s] = ws[2][l];
+					}
+					covered |= inside;
+				}
+				if (covered)
+					shade_msaa_quad<S, STATE>(shader, x, y, coverage, w, p0, p1, p2, var, ms);
+				lines = sample_lines(coverage);
+			} else {
+				covered = ~(e0 | e1 | e2).lt_zero() & lanes;
+				lines = covered;
+				if (covered) {
+					const float4_t w[3] = {
+						(e0 + unbias[0]).to_float() * float4_t(inv_area),
+						(e1 + unbias[1]).to_float() * float4_t(inv_area),
+						(e2 + unbias[2]).to_float() * float4_t(inv_area),
+					};
+					shade_quad<S, STATE>(shader, x, covered, w, p0, p1, p2, var, depth_rows, color_rows);
+				}
+			}
+			if (span.next(lines))
+				break;
+
+			e0 = e0 + quad_step[0];
+			e1 = e1 + quad_step[1];
+			e2 = e2 + quad_step[2];
+		}
+
+		e[0].row += 2 * e[0].step_y;
+		e[1].row += 2 * e[1].step_y;
+		e[2].row += 2 * e[2].step_y;
+	}
+}
+
+/* Edge functions of lanes of a quad, see edge_function() */
+inline float4_t edge_function(const vec3f_t& a, const vec3f_t& b, const float4_t& px, const float4_t& py)
+{
+	return float4_t(a.x - b.x) * (py - float4_t(a.y)) - float4_t(a.y - b.y) * (px - float4_t(a.x));
+}
+
+/* Lanes of a quad inside an edge, see is_inside() */
+inline unsigned is_inside(const float4_t& w, const vec3f_t& edge)
+{
+	unsigned outside = w.lt_zero();
+	if ((edge.y == 0 && edge.x <= 0) || edge.y < 0)
+		outside |= w.eq_zero();
+	return ~outside & QUAD_FULL;
+}
+
+/* Rasterize a triangle in screen coordinates within a clipping rectangle */
+template <shader S, unsigned STATE>
+void raster_triangle(const S& shader, vec3f_t p0, vec3f_t p1, vec3f_t p2,
+	typename S::varyings_t var[3], const rect_t& clip,
+	const display::surface_t& fb, const zbuf::surface_t& zb, const msaa::surface_t& ms)
+{
+	constexpr cull_mode CULL = static_cast<cull_mode>(STATE >> CULL_SHIFT);
+
+	if constexpr (STATE & FIXED_POINT) {
+		auto in_guard_band = [](const vec3f_t& p) {
+			return std::abs(p.x) <= GUARD_BAND && std::abs(p.y) <= GUARD_BAND;
+		};
+
+		/* the rare triangle outside of the guard band takes the float path */
+		if (in_guard_band(p0) && in_guard_band(p1) && in_guard_band(p2)) {
+			raster_fixed<S, STATE>(shader, p0, p1, p2, var, clip, fb, zb, ms);
+			return;
+		}
+	}
+
+	/* Calculate area of the triangle multiplied by 2. Front faces have
+	 * positive area.
+	 */
+	auto area = edge_function(p0, p1, p2);
+	if (is_culled<CULL>(area))
+		return;
+
+	/* rasterize back faces as front ones with swapped vertices */
+	if constexpr (CULL != cull_mode::back) {
+		if (area < 0) {
+			std::swap(p1, p2);
+			std::swap(var[1], var[2]);
+			area = -area;
+		}
+	}
+
+	/* bounding box, the only clipping done for a triangle */
+	vec2i_t bbox_min = { (int)std::min({p0.x, p1.x, p2.x}), (int)std::min({p0.y, p1.y, p2.y}) };
+	vec2i_t bbox_max = { (int)std::max({p0.x, p1.x, p2.x}), (int)std::max({p0.y, p1.y, p2.y}) };
+	if (!clamp_bbox(bbox_min, bbox_max, clip))
+		return;
+	const quad_bounds_t bounds(bbox_min, bbox_max);
+
+	const vec3f_t edge0 = p2 - p1;
+	const vec3f_t edge1 = p0 - p2;
+	const vec3f_t edge2 = p1 - p0;
+
+	/* edge function offsets of samples from the pixel center */
+	float sample[3][msaa::SAMPLES];
+	if constexpr (STATE & MSAA) {
+		const vec3f_t *edges[3] = { &edge0, &edge1, &edge2 };
+		for (int i = 0; i < 3; i++) {
+			for (int s = 0; s < msaa::SAMPLES; s++)
+				sample[i][s] = msaa::OFFSETS[s][0] * edges[i]->y - msaa::OFFSETS[s][1] * edges[i]->x;
+		}
+	}
+
+	const float4_t area4(area);
+	for (int y = bounds.min.y; y <= bounds.max.y; y += 2) {
+		const unsigned rows = bounds.rows(y);
+		void *depth_rows[2];
+		uint32_t *color_rows[2];
+		bounds.get_rows<S, STATE>(rows, y, fb, zb, depth_rows, color_rows);
+		quad_span_t span = start_span<STATE>(rows);
+
+		/* pixel centers of the lanes */
+		const float4_t py(y + 0.5f, y + 0.5f, (y + 1) + 0.5f, (y + 1) + 0.5f);
+
+		for (int x = bounds.min.x; x <= bounds.max.x; x += 2) {
+			const unsigned lanes = bounds.lanes(rows, x);
+			const float4_t px(x + 0.5f, (x + 1) + 0.5f, x + 0.5f, (x + 1) + 0.5f);
+
+			/* to barycentric coordinates */
+			/* w0: signed area of the triangle v1v2p multiplied by 2 */
+			float4_t w0 = edge_function(p1, p2, px, py);
+			/* w1: signed area of the triangle v2v0p multiplied by 2 */
+			float4_t w1 = edge_function(p2, p0, px, py);
+			/* w2: signed area of the triangle v0v1p multiplied by 2 */
+			float4_t w2 = edge_function(p0, p1, px, py);
+			unsigned covered = 0;
+			/* lines covered, see quad_span_t */
+			unsigned lines;
+
+			if constexpr (STATE & MSAA) {
+				float lw[3][QUAD_LANES];
+				w0.store(lw[0]);
+				w1.store(lw[1]);
+				w2.store(lw[2]);
+
+				float w[QUAD_LANES][3][msaa::SAMPLES];
+				unsigned coverage[QUAD_LANES];
+				for (int l = 0; l < QUAD_LANES; l++) {
+					coverage[l] = 0;
+					for (int s = 0; s < msaa::SAMPLES; s++) {
+						float s0 = lw[0][l] + sample[0][s];
+						float s1 = lw[1][l] + sample[1][s];
+						float s2 = lw[2][l] + sample[2][s];
+						if (is_inside(s0, edge0) && is_inside(s1, edge1) && is_inside(s2, edge2))
+							coverage[l] |= 1u << s;
+						w[l][0][s] = s0 / area;
+						w[l][1][s] = s1 / area;
+						w[l][2][s] = s2 / area;
+					}
+					if (!(lanes & (1u << l)))
+						coverage[l] = 0;
+					if (coverage[l])
+						covered |= 1u << l;
+				}
+				if (covered)
+					shade_msaa_quad<S, STATE>(shader, x, y, coverage, w, p0, p1, p2, var, ms);
+				lines = sample_lines(coverage);
+			} else {
+				covered = is_inside(w0, edge0) & is_inside(w1, edge1) & is_inside(w2, edge2) & lanes;
+				lines = covered;
+
+				/* If we are here the points of covered lanes are inside the
+				 * triangle{p0, p1, p2}. Normalize coefficients.
+				 */
+				if (covered) {
+					const float4_t w[3] = { w0 / area4, w1 / area4, w2 / area4 };
+					shade_quad<S, STATE>(shader, x, covered, w, p0, p1, p2, var, depth_rows, color_rows);
+				}
+			}
+			if (span.next(lines))
+				break;
+		}
+	}
+}
+
+template <shader S, unsigned STATE>
+void raster(const S& shader, const Vertex& v0, const Vertex& v1, const Vertex& v2)
+{
+	auto [fb, zb, ms] = get_surfaces(shader, STATE);
+
+	/* vertex stage and perspective divide */
+	typename S::varyings_t var[3];
+	vec4f_t h0 = shader.vertex(v0, var[0]);
+	vec4f_t h1 = shader.vertex(v1, var[1]);
+	vec4f_t h2 = shader.vertex(v2, var[2]);
+	vec3f_t p0 = h0 / h0.w;
+	vec3f_t p1 = h1 / h1.w;
+	vec3f_t p2 = h2 / h2.w;
+
+	raster_triangle<S, STATE>(shader, p0, p1, p2, var, { 0, 0, zb.width - 1, zb.height - 1 }, fb, zb, ms);
+}
+
+/* A triangle after the vertex stage */
+template <shader S>
+struct setup_t {
+	vec3f_t p[3];
+	typename S::varyings_t var[3];
+};
+
+/* Rasterize part of a set up triangle within a screen tile */
+template <shader S, unsigned STATE>
+void raster_tile(const S& shader, const setup_t<S>& t, const rect_t& clip,
+	const display::surface_t& fb, const zbuf::surface_t& zb, const msaa::surface_t& ms)
+{
+	/* the rasterizer swaps varyings of back faces, keep the original ones
+	 * for other tiles
+	 */
+	typename S::varyings_t var[3] = { t.var[0], t.var[1], t.var[2] };
+	raster_triangle<S, STATE>(shader, t.p[0], t.p[1], t.p[2], var, clip, fb, zb, ms);
+}
+
+template <shader S>
+using raster_fn = void (*)(const S&, const Vertex&, const Vertex&, const Vertex&);
+
+template <shader S>
+using raster_tile_fn = void (*)(const S&, const setup_t<S>&, const rect_t&,
+	const display::surface_t&, const zbuf::surface_t&, const msaa::surface_t&);
+
+template <shader S, unsigned... STATE>
+constexpr std::array<raster_fn<S>, sizeof...(STATE)> make_raster_table(std::integer_sequence<unsigned, STATE...>)
+{
+	return { raster<S, canonical_state<S>(STATE)>... };
+}
+
+template <shader S, unsigned... STATE>
+constexpr std::array<raster_tile_fn<S>, sizeof...(STATE)> make_raster_tile_table(std::integer_sequence<unsigned, STATE...>)
+{
+	return { raster_tile<S, canonical_state<S>(STATE)>... };
+}
+
+/** Rasterizer specializations for a shader indexed by fixed function state */
+template <shader S>
+inline constexpr auto raster_table = make_raster_table<S>(std::make_integer_sequence<unsigned, STATE_COUNT>());
+
+template <shader S>
+inline constexpr auto raster_tile_table = make_raster_tile_table<S>(std::make_integer_sequence<unsigned, STATE_COUNT>());
+
+/* Binning: the screen is split into BIN_TILE x BIN_TILE pixel tiles which are
+ * rasterized in parallel. The tile size is a multiple of msaa::TILE, so a
+ * sample tile is never shared by two jobs.
+ */
+constexpr int BIN_TILE = 64;
+/* Triangles per vertex stage and binning job */
+constexpr size_t BIN_CHUNK = 512;
+static_assert(BIN_TILE % msaa::TILE == 0);
+
+/* Triangles after the vertex stage binned to screen tiles. Arrays are
+ * allocated from arenas of the frame.
+ */
+template <shader S>
+struct bins_t {
+	/* Triangles of a chunk overlapping tile t are
+	 * index[offset[t]] ... index[offset[t + 1] - 1]
+	 */
+	struct chunk_t {
+		const uint32_t *offset;
+		const uint32_t *index;
+	};
+
+	setup_t<S> *tris;
+	chunk_t *chunks;
+	size_t chunk_count;
+	int width;
+	int height;
+	int tiles_x;
+	int tiles_y;
+};
+
+/** Run the vertex stage and bin triangles in parallel
+ * Jobs process chunks of triangles, each chunk has its own bins.
+ *
+ * @param shader: shader to process vertices with.
+ * @param count: number of triangles.
+ * @param fetch: fetch(i, Vertex v[3]) fills vertices of triangle i. Called
+ * from job threads.
+ * @param width, height: size of the surface to bin to.
+ * @param mem: arenas of the frame to allocate bins from.
+ * @param b: output bins.
+ */
+template <shader S, typename FETCH>
+void geometry(const S& shader, size_t count, const FETCH& fetch, int width, int height,
+	frame::memory_t& mem, bins_t<S>& b)
+{
+	b.width = width;
+	b.height = height;
+	b.tiles_x = (width + BIN_TILE - 1) / BIN_TILE;
+	b.tiles_y = (height + BIN_TILE - 1) / BIN_TILE;
+	b.chunk_count = (count + BIN_CHUNK - 1) / BIN_CHUNK;
+
+	const size_t tiles = (size_t)b.tiles_x * b.tiles_y;
+	b.tris = mem.thread().alloc_array<setup_t<S>>(count);
+	b.chunks = mem.thread().alloc_array<typename bins_t<S>::chunk_t>(b.chunk_count);
+
+	jobs::parallel_for(b.chunk_count, 1, [&](size_t begin, size_t end) {
+		PROFILE_ZONE("vertex processing");
+		memory::arena_t& arena = mem.thread();
+
+		for (size_t c = begin; c < end; c++) {
+			const size_t first = c * BIN_CHUNK;
+			const size_t last = std::min(count, first + BIN_CHUNK);
+			/* tiles overlapped by a triangle, empty if it's off-screen */
+			rect_t range[BIN_CHUNK];
+			/* triangles per tile counted at offset[tile + 1] */
+			uint32_t *offset = arena.alloc_array<uint32_t>(tiles + 1);
+			std::fill(offset, offset + tiles + 1, 0);
+
+			for (size_t i = first; i < last; i++) {
+				setup_t<S>& t = b.tris[i];
+				rect_t& r = range[i - first];
+				Vertex v[3];
+
+				/* vertex stage and perspective divide */
+				fetch(i, v);
+				for (size_t k = 0; k < 3; k++) {
+					vec4f_t h = shader.vertex(v[k], t.var[k]);
+					t.p[k] = h / h.w;
+				}
+
+				/* Bounding box a pixel wider than the triangle: the fixed
+				 * point rasterizer snaps vertices, MSAA touches pixels
+				 * partially covered.
+				 */
+				float min_x = std::min({ t.p[0].x, t.p[1].x, t.p[2].x }) - 1.f;
+				float min_y = std::min({ t.p[0].y, t.p[1].y, t.p[2].y }) - 1.f;
+				float max_x = std::max({ t.p[0].x, t.p[1].x, t.p[2].x }) + 1.f;
+				float max_y = std::max({ t.p[0].y, t.p[1].y, t.p[2].y }) + 1.f;
+				/* off-screen or not a number */
+				if (!(max_x >= 0.f && max_y >= 0.f && min_x < (float)width && min_y < (float)height)) {
+					r = { 0, 0, -1, -1 };
+					continue;
+				}
+
+				r.x0 = (int)std::max(min_x, 0.f) / BIN_TILE;
+				r.y0 = (int)std::max(min_y, 0.f) / BIN_TILE;
+				r.x1 = (int)std::min(max_x, width - 1.f) / BIN_TILE;
+				r.y1 = (int)std::min(max_y, height - 1.f) / BIN_TILE;
+				for (int ty = r.y0; ty <= r.y1; ty++) {
+					for (int tx = r.x0; tx <= r.x1; tx++)
+						offset[(size_t)ty * b.tiles_x + tx + 1]++;
+				}
+			}
+
+			/* counts to offsets, then fill the bins in the triangle order */
+			for (size_t t = 1; t <= tiles; t++)
+				offset[t] += offset[t - 1];
+			uint32_t *index = arena.alloc_array<uint32_t>(offset[tiles]);
+			uint32_t *cursor = arena.alloc_array<uint32_t>(tiles);
+			std::copy(offset, offset + tiles, cursor);
+
+			for (size_t i = first; i < last; i++) {
+				const rect_t& r = range[i - first];
+				for (int ty = r.y0; ty <= r.y1; ty++) {
+					for (int tx = r.x0; tx <= r.x1; tx++)
+						index[cursor[(size_t)ty * b.tiles_x + tx]++] = (uint32_t)i;
+				}
+			}
+
+			b.chunks[c] = { offset, index };
+		}
+	});
+}
+
+/** Rasterize binned triangles, tiles in parallel
+ * Triangles of a tile are drawn in the submission order, so the result is the
+ * same as of raster() one by one.
+ *
+ * @param shader: shader to process fragments with.
+ * @param state: fixed function state.
+ * @param b: triangles binned by geometry() to the size of the current
+ * surface.
+ */
+template <shader S>
+void raster_bins(const S& shader, unsigned state, const bins_t<S>& b)
+{
+	const auto rasterize = raster_tile_table<S>[state];
+	const surfaces_t s = get_surfaces(shader, state);
+
+	const size_t tiles = (size_t)b.tiles_x * b.tiles_y;
+	jobs::parallel_for(tiles, 1, [&](size_t begin, size_t end) {
+		PROFILE_ZONE("raster tiles");
+		for (size_t tile = begin; tile < end; tile++) {
+			int tx = (int)(tile % b.tiles_x) * BIN_TILE;
+			int ty = (int)(tile / b.tiles_x) * BIN_TILE;
+			rect_t clip = { tx, ty, std::min(tx + BIN_TILE, b.width) - 1, std::min(ty + BIN_TILE, b.height) - 1 };
+
+			for (size_t c = 0; c < b.chunk_count; c++) {
+				const auto& chunk = b.chunks[c];
+				for (uint32_t k = chunk.offset[tile]; k < chunk.offset[tile + 1]; k++)
+					rasterize(shader, b.tris[chunk.index[k]], clip, s.fb, s.zb, s.ms);
+			}
+		}
+	});
+}
+
+/* A batch of triangles recorded to a frame packet. It keeps copies of the
+ * shader (with its uniforms) and of the fixed function state.
+ */
+template <shader S, typename FETCH>
+struct batch_t : frame::draw_t {
+	S shader;
+	FETCH fetch;
+	size_t count;
+	unsigned state;
+	int width;
+	int height;
+	/* arenas of the frame the batch is recorded to */
+	frame::memory_t *mem;
+	/* filled by the geometry job */
+	mutable bins_t<S> bins;
+
+	batch_t(const S& shader, size_t count, const FETCH& fetch, unsigned state, int width, int height,
+		frame::memory_t *mem)
+		: shader(shader), fetch(fetch), count(count), state(state), width(width), height(height), mem(mem)
+	{
+	}
+
+	static void geometry_job(const void *ctx, size_t, size_t)
+	{
+		auto self = static_cast<const batch_t *>(ctx);
+		geometry(self->shader, self->count, self->fetch, self->width, self->height, *self->mem, self->bins);
+	}
+
+	void raster(void) override
+	{
+		raster_bins(shader, state, bins);
+	}
+};
+
+/** Draw a batch of triangles in parallel
+ * With pipelining the batch is recorded to the frame packet and its vertex
+ * stage is started as a job. Otherwise the batch is drawn right away.
+ *
+ * @param shader: shader to process vertices and fragments with.
+ * @param count: number of triangles.
+ * @param fetch: fetch(i, Vertex v[3]) fills vertices of triangle i. Called
+ * from job threads. With pipelining fetch is copied and called up to the next
+ * render::update(), so data it refers to must be valid till then.
+ */
+template <shader S, typename FETCH>
+void draw(const S& shader, size_t count, const FETCH& fetch)
+{
+	/* bin to the depth target size */
+	auto zb = get_surfaces(shader, 0).zb;
+
+	if (is_pipelining_enabled()) {
+		auto batch = frame::create<batch_t<S, FETCH>>(shader, count, fetch, get_state(shader), zb.width, zb.height,
+			&frame::get_memory());
+		auto job = jobs::create(batch_t<S, FETCH>::geometry_job, batch);
+		frame::record(batch, job);
+		return;
+	}
+
+	bins_t<S> bins;
+
+	geometry(shader, count, fetch, zb.width, zb.height, frame::get_memory(), bins);
+	raster_bins(shader, get_state(shader), bins);
+}
+
+} /* namespace pipeline */
+
+} /* namespace render */
+
+#endif /* RENDER_PIPELINE_H_ */
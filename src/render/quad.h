@@ -0,0 +1,248 @@
+#ifndef RENDER_QUAD_H_
+#define RENDER_QUAD_H_
+
+#include <cstdint>
+#include <simd.h>
+
+namespace render {
+
+/* Pixels are rasterized in quads of 2x2 aligned to even coordinates. Lane i
+ * of a quad is the pixel (x + (i & 1), y + (i >> 1)), a lane mask has bit i
+ * set for lane i.
+ */
+constexpr int QUAD_LANES = 4;
+constexpr unsigned QUAD_FULL = (1u << QUAD_LANES) - 1;
+
+/* A float per lane of a quad. Operations are lane-wise IEEE ones, so a lane
+ * gets the same result as the scalar code would.
+ */
+struct float4_t {
+#if defined(SIMD_SSE)
+	__m128 v;
+
+	float4_t(void) : v(_mm_setzero_ps()) {}
+	explicit float4_t(__m128 v) : v(v) {}
+	explicit float4_t(float f) : v(_mm_set1_ps(f)) {}
+	float4_t(float l0, float l1, float l2, float l3) : v(_mm_setr_ps(l0, l1, l2, l3)) {}
+
+	float4_t operator+(const float4_t& rhs) const { return float4_t(_mm_add_ps(v, rhs.v)); }
+	float4_t operator-(const float4_t& rhs) const { return float4_t(_mm_sub_ps(v, rhs.v)); }
+	float4_t operator*(const float4_t& rhs) const { return float4_t(_mm_mul_ps(v, rhs.v)); }
+	float4_t operator/(const float4_t& rhs) const { return float4_t(_mm_div_ps(v, rhs.v)); }
+
+	/* lane masks of comparisons to zero, false for NaN */
+	unsigned lt_zero(void) const { return (unsigned)_mm_movemask_ps(_mm_cmplt_ps(v, _mm_setzero_ps())); }
+	unsigned eq_zero(void) const { return (unsigned)_mm_movemask_ps(_mm_cmpeq_ps(v, _mm_setzero_ps())); }
+
+	void store(float out[QUAD_LANES]) const { _mm_storeu_ps(out, v); }
+#elif defined(SIMD_NEON)
+	float32x4_t v;
+
+	float4_t(void) : v(vdupq_n_f32(0.f)) {}
+	explicit float4_t(float32x4_t v) : v(v) {}
+	explicit float4_t(float f) : v(vdupq_n_f32(f)) {}
+	float4_t(float l0, float l1, float l2, float l3)
+	{
+		const float l[QUAD_LANES] = { l0, l1, l2, l3 };
+		v = vld1q_f32(l);
+	}
+
+	float4_t operator+(const float4_t& rhs) const { return float4_t(vaddq_f32(v, rhs.v)); }
+	float4_t operator-(const float4_t& rhs) const { return float4_t(vsubq_f32(v, rhs.v)); }
+	float4_t operator*(const float4_t& rhs) const { return float4_t(vmulq_f32(v, rhs.v)); }
+	float4_t operator/(const float4_t& rhs) const { return float4_t(vdivq_f32(v, rhs.v)); }
+
+	unsigned lt_zero(void) const { return mask(vcltq_f32(v, vdupq_n_f32(0.f))); }
+	unsigned eq_zero(void) const { return mask(vceqq_f32(v, vdupq_n_f32(0.f))); }
+
+	void store(float out[QUAD_LANES]) const { vst1q_f32(out, v); }
+
+	static unsigned mask(uint32x4_t m)
+	{
+		const uint32_t bits[QUAD_LANES] = { 1, 2, 4, 8 };
+		return vaddvq_u32(vandq_u32(m, vld1q_u32(bits)));
+	}
+#else
+	float v[QUAD_LANES];
+
+	float4_t(void) : v{} {}
+	explicit float4_t(float f) : v{ f, f, f, f } {}
+	float4_t(float l0, float l1, float l2, float l3) : v{ l0, l1, l2, l3 } {}
+
+	float4_t operator+(const float4_t& rhs) const { return apply(rhs, [](float a, float b) { return a + b; }); }
+	float4_t operator-(const float4_t& rhs) const { return apply(rhs, [](float a, float b) { return a - b; }); }
+	float4_t operator*(const float4_t& rhs) const { return apply(rhs, [](float a, float b) { return a * b; }); }
+	float4_t operator/(const float4_t& rhs) const { return apply(rhs, [](float a, float b) { return a / b; }); }
+
+	unsigned lt_zero(void) const
+	{
+		unsigned m = 0;
+		for (int i = 0; i < QUAD_LANES; i++)
+			m |= (v[i] < 0.f ? 1u : 0u) << i;
+		return m;
+	}
+
+	unsigned eq_zero(void) const
+	{
+		unsigned m = 0;
+		for (int i = 0; i < QUAD_LANES; i++)
+			m |= (v[i] == 0.f ? 1u : 0u) << i;
+		return m;
+	}
+
+	void store(float out[QUAD_LANES]) const
+	{
+		for (int i = 0; i < QUAD_LANES; i++)
+			out[i] = v[i];
+	}
+
+	template <typename F>
+	float4_t apply(const float4_t& rhs, F f) const
+	{
+		return { f(v[0], rhs.v[0]), f(v[1], rhs.v[1]), f(v[2], rhs.v[2]), f(v[3], rhs.v[3]) };
+	}
+#endif
+};
+
+/* An int64_t per lane of a quad: edge functions of the fixed point
+ * rasterizer. SSE2 and NEON have no 4-wide 64-bit vectors, a value is a pair
+ * of 2-wide ones.
+ */
+struct int64x4_t {
+#if defined(SIMD_SSE)
+	__m128i lo, hi;
+
+	int64x4_t(void) : lo(_mm_setzero_si128()), hi(_mm_setzero_si128()) {}
+	int64x4_t(__m128i lo, __m128i hi) : lo(lo), hi(hi) {}
+	explicit int64x4_t(int64_t i) : lo(_mm_set1_epi64x(i)), hi(_mm_set1_epi64x(i)) {}
+	int64x4_t(int64_t l0, int64_t l1, int64_t l2, int64_t l3)
+		: lo(_mm_set_epi64x(l1, l0)), hi(_mm_set_epi64x(l3, l2)) {}
+
+	int64x4_t operator+(const int64x4_t& rhs) const
+	{
+		return { _mm_add_epi64(lo, rhs.lo), _mm_add_epi64(hi, rhs.hi) };
+	}
+
+	int64x4_t operator|(const int64x4_t& rhs) const
+	{
+		return { _mm_or_si128(lo, rhs.lo), _mm_or_si128(hi, rhs.hi) };
+	}
+
+	/* lane mask of negative values: the sign bits */
+	unsigned lt_zero(void) const
+	{
+		return (unsigned)(_mm_movemask_pd(_mm_castsi128_pd(lo)) | _mm_movemask_pd(_mm_castsi128_pd(hi)) << 2);
+	}
+
+	void store(int64_t out[QUAD_LANES]) const
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2), hi);
+	}
+#elif defined(SIMD_NEON)
+	int64x2_t lo, hi;
+
+	int64x4_t(void) : lo(vdupq_n_s64(0)), hi(vdupq_n_s64(0)) {}
+	int64x4_t(int64x2_t lo, int64x2_t hi) : lo(lo), hi(hi) {}
+	explicit int64x4_t(int64_t i) : lo(vdupq_n_s64(i)), hi(vdupq_n_s64(i)) {}
+	int64x4_t(int64_t l0, int64_t l1, int64_t l2, int64_t l3)
+	{
+		const int64_t l[QUAD_LANES] = { l0, l1, l2, l3 };
+		lo = vld1q_s64(l);
+		hi = vld1q_s64(l + 2);
+	}
+
+	int64x4_t operator+(const int64x4_t& rhs) const { return { vaddq_s64(lo, rhs.lo), vaddq_s64(hi, rhs.hi) }; }
+	int64x4_t operator|(const int64x4_t& rhs) const { return { vorrq_s64(lo, rhs.lo), vorrq_s64(hi, rhs.hi) }; }
+
+	unsigned lt_zero(void) const
+	{
+		uint64x2_t l = vshrq_n_u64(vreinterpretq_u64_s64(lo), 63);
+		uint64x2_t h = vshrq_n_u64(vreinterpretq_u64_s64(hi), 63);
+		return (unsigned)(vgetq_lane_u64(l, 0) | vgetq_lane_u64(l, 1) << 1 |
+			vgetq_lane_u64(h, 0) << 2 | vgetq_lane_u64(h, 1) << 3);
+	}
+
+	void store(int64_t out[QUAD_LANES]) const
+	{
+		vst1q_s64(out, lo);
+		vst1q_s64(out + 2, hi);
+	}
+#else
+	int64_t v[QUAD_LANES];
+
+	int64x4_t(void) : v{} {}
+	explicit int64x4_t(int64_t i) : v{ i, i, i, i } {}
+	int64x4_t(int64_t l0, int64_t l1, int64_t l2, int64_t l3) : v{ l0, l1, l2, l3 } {}
+
+	int64x4_t operator+(const int64x4_t& rhs) const
+	{
+		return { v[0] + rhs.v[0], v[1] + rhs.v[1], v[2] + rhs.v[2], v[3] + rhs.v[3] };
+	}
+
+	int64x4_t operator|(const int64x4_t& rhs) const
+	{
+		return { v[0] | rhs.v[0], v[1] | rhs.v[1], v[2] | rhs.v[2], v[3] | rhs.v[3] };
+	}
+
+	unsigned lt_zero(void) const
+	{
+		unsigned m = 0;
+		for (int i = 0; i < QUAD_LANES; i++)
+			m |= (v[i] < 0 ? 1u : 0u) << i;
+		return m;
+	}
+
+	void store(int64_t out[QUAD_LANES]) const
+	{
+		for (int i = 0; i < QUAD_LANES; i++)
+			out[i] = v[i];
+	}
+#endif
+
+	/* Lanes converted to float. There is no 64-bit integer conversion
+	 * before AVX-512, it's done lane by lane
+	 */
+	float4_t to_float(void) const
+	{
+		int64_t l[QUAD_LANES];
+		store(l);
+		return float4_t((float)l[0], (float)l[1], (float)l[2], (float)l[3]);
+	}
+};
+
+/** Varyings of a quad and the lane being shaded
+ * Every lane of a quad is interpolated, including helper lanes: pixels
+ * outside of the triangle, failing the depth test or off the surface. Their
+ * varyings are extrapolated from the triangle, so derivatives are defined
+ * for every shaded pixel, e.g. to select a texture mip level.
+ */
+template <typename V>
+struct quad_t {
+	V var[QUAD_LANES];
+	int lane;
+
+	/** Varyings of the pixel */
+	const V& in(void) const
+	{
+		return var[lane];
+	}
+
+	/** Change of varyings to the next pixel to the right (fine derivative,
+	 * per row of the quad)
+	 */
+	V ddx(void) const
+	{
+		return var[lane | 1] + var[lane & ~1] * -1.f;
+	}
+
+	/** Change of varyings to the next pixel down (per column of the quad) */
+	V ddy(void) const
+	{
+		return var[lane | 2] + var[lane & ~2] * -1.f;
+	}
+};
+
+} /* namespace render */
+
+#endif /* RENDER_QUAD_H_ */
@@ -1,7 +1,62 @@
 #include "render.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
 #include <display/display.h>
+#include <jobs/jobs.h>
+#include <profile/profile.h>
+#include <render/frame.h>
+#include <render/msaa.h>
+#include <render/scaler.h>
+#include <render/shadow.h>
+#include <textures/textures.h>
 
 static bool zbuf_enabled = true;
+static bool zbuf_write_enabled = true;
+static bool lighting_enabled = true;
+static bool fixed_point_enabled = false;
+static bool msaa_enabled = false;
+static bool mipmapping_enabled = true;
+static float lod_bias = 0.f;
+static render::cull_mode cull = render::cull_mode::back;
+
+/* Directional light and its shadow map */
+static vec3f_t light_dir{ 0.f, 0.f, 1.f };
+static float light_intensity = 1.f;
+static render::lighting_mode lighting = render::lighting_mode::per_pixel;
+static bool shadow_enabled = false;
+static bool shadow_pcf_enabled = false;
+static vec3f_t shadow_center{ 0.f, 0.f, 0.f };
+static float shadow_radius = 1.f;
+
+/* Resolution scaling. The color buffer is used only if the render resolution
+ * is lower than the display one. It has one pixel more for the upscaler.
+ */
+static float resolution_scale = 1.f;
+static int render_width;
+static int render_height;
+static std::vector<uint32_t> colorbuffer;
+static render::scaler::controller_t controller;
+static std::chrono::steady_clock::time_point frame_start;
+
+/* Pipelining: a packet is recorded while the previous one is rasterized */
+struct packet_t {
+	/* allocated from mem.frame */
+	std::vector<render::frame::draw_t *> draws;
+	std::vector<jobs::job_t *> geometry;
+	render::frame::memory_t mem;
+	/* shadow mapping was enabled when the packet was recorded */
+	bool shadow;
+};
+static bool pipelining_enabled = false;
+static packet_t packets[2];
+static unsigned recording;
+/* raster job of the previous packet, nullptr when finished */
+static jobs::job_t *raster_job;
+static float raster_ms;
+static bool present_pending;
 
 /* Apply model rotation, scaling, transformation.
  * In other words converts model coordinates to world coordinates:
@@ -19,17 +74,242 @@ static mat4x4f_t projection;
 /* Convert homogeneous coordinates (-1.0, 1.0) to screen coordinates */
 static mat4x4f_t viewport;
 
+/* Distance from the camera to the point it looks at, see lookat() */
+static float camera_distance = 1.f;
+/* Depth range of the formats other than float32 */
+static float depth_near = 0.1f;
+static float depth_far = 100.f;
+
 /* A product of (viewport * projection * view * model) */
 static mat4x4f_t MVP;
+/* A product of (shadow map projection * model) */
+static mat4x4f_t light_MVP;
+/* Inverse transpose of the model 3x3 part */
+static mat3x3f_t normal_matrix;
+
+/* Cofactors of the model 3x3 part divided by its determinant. The scale isn't
+ * important for lighting (normals are normalized), but a mirroring model
+ * mustn't flip normals.
+ */
+static void update_normal_matrix(void)
+{
+	auto m = [](size_t r, size_t c) { return model(r, c); };
+
+	normal_matrix(0, 0) = m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1);
+	normal_matrix(0, 1) = m(1, 2) * m(2, 0) - m(1, 0) * m(2, 2);
+	normal_matrix(0, 2) = m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0);
+	normal_matrix(1, 0) = m(0, 2) * m(2, 1) - m(0, 1) * m(2, 2);
+	normal_matrix(1, 1) = m(0, 0) * m(2, 2) - m(0, 2) * m(2, 0);
+	normal_matrix(1, 2) = m(0, 1) * m(2, 0) - m(0, 0) * m(2, 1);
+	normal_matrix(2, 0) = m(0, 1) * m(1, 2) - m(0, 2) * m(1, 1);
+	normal_matrix(2, 1) = m(0, 2) * m(1, 0) - m(0, 0) * m(1, 2);
+	normal_matrix(2, 2) = m(0, 0) * m(1, 1) - m(0, 1) * m(1, 0);
+
+	float det = m(0, 0) * normal_matrix(0, 0) + m(0, 1) * normal_matrix(0, 1) + m(0, 2) * normal_matrix(0, 2);
+	if (det != 0.f)
+		normal_matrix /= det;
+}
 
 static void update_MVP(void)
 {
 	MVP = viewport * projection * view * model;
+	light_MVP = render::shadow::get_matrix() * model;
+	update_normal_matrix();
+}
+
+static void update_light(void)
+{
+	if (shadow_enabled)
+		render::shadow::set_projection(light_dir, shadow_center, shadow_radius);
+	update_MVP();
+}
+
+/* Set the depth row of the projection for the depth buffer format. Distance
+ * to a point is camera_distance * w, depth is linear in 1 / w, so it's
+ * interpolated in screen space:
+ * - float32: view space z as is;
+ * - reversed_float32: near / distance;
+ * - unorm formats: near / distance mapped to 1 at the near plane and 0 at the
+ *   far one.
+ */
+static void update_depth_projection(void)
+{
+	float c = camera_distance;
+
+	projection(2, 0) = 0.f;
+	projection(2, 1) = 0.f;
+	switch (render::zbuf::get_format()) {
+	case render::zbuf::format::float32:
+		projection(2, 2) = 1.f;
+		projection(2, 3) = 0.f;
+		break;
+	case render::zbuf::format::reversed_float32:
+		projection(2, 2) = 0.f;
+		projection(2, 3) = depth_near / c;
+		break;
+	default: {
+		float a = depth_near * depth_far / (depth_far - depth_near);
+		float b = -depth_near / (depth_far - depth_near);
+		projection(2, 2) = -b / c;
+		projection(2, 3) = a / c + b;
+		break;
+	}
+	}
+
+	update_MVP();
+}
+
+static void set_viewport(int w, int h)
+{
+	viewport.identity();
+	viewport(0, 0) = w / 2.f;
+	viewport(0, 3) = w / 2.f;
+
+	viewport(1, 1) = (-h / 2.f);
+	viewport(1, 3) = h / 2.f;
+}
+
+/* Wait for the raster job of the previous packet, its geometry jobs are
+ * finished too then and their handles may be reused by the job system
+ */
+static void wait_raster(void)
+{
+	if (raster_job) {
+		jobs::wait(raster_job);
+		raster_job = nullptr;
+		packets[recording ^ 1].geometry.clear();
+	}
+}
+
+/* Show a frame queued by the previous update() */
+static int present_raster(void)
+{
+	wait_raster();
+	if (!present_pending)
+		return 0;
+
+	resolution_scale = controller.update(raster_ms, resolution_scale);
+	present_pending = false;
+	return display::update();
+}
+
+/* Drop draws of a packet once their geometry jobs are finished */
+static void discard(packet_t& p)
+{
+	for (auto job : p.geometry)
+		jobs::wait(job);
+	p.geometry.clear();
+	for (auto draw : p.draws)
+		draw->~draw_t();
+	p.draws.clear();
+}
+
+static void clear_buffers(bool shadow)
+{
+	/* pixels per job */
+	constexpr size_t CLEAR_GRAIN = 1 << 16;
+
+	PROFILE_ZONE("clear buffers");
+	/* tiles are contiguous, clear them with the padding */
+	auto fb = render::get_surface();
+	jobs::parallel_for(display::tile_size(fb.width, fb.height), CLEAR_GRAIN, [&fb](size_t begin, size_t end) {
+		std::fill(fb.pixels + begin, fb.pixels + end, (uint32_t)0xFF000000);
+	});
+	if (msaa_enabled)
+		render::msaa::clear();
+	else
+		render::zbuf::clear();
+	if (shadow)
+		render::shadow::clear();
+}
+
+/* Resolve samples and upscale to the display frame buffer */
+static void resolve_buffers(void)
+{
+	PROFILE_ZONE("resolve");
+	if (msaa_enabled)
+		render::msaa::resolve();
+
+	auto fb = render::get_surface();
+	auto screen = display::get_surface();
+	if (fb.pixels != screen.pixels)
+		render::scaler::upscale(fb, screen);
+}
+
+static void raster_packet(const void *ctx, size_t, size_t)
+{
+	auto p = static_cast<const packet_t *>(ctx);
+	PROFILE_ZONE("raster frame");
+	auto start = std::chrono::steady_clock::now();
+
+	clear_buffers(p->shadow);
+	for (auto& draw : p->draws)
+		draw->raster();
+	resolve_buffers();
+
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	raster_ms = elapsed.count();
+}
+
+void render::frame::memory_t::reset(void)
+{
+	/* sized on the first use and when the job system is restarted */
+	if (thread_count != jobs::get_thread_count()) {
+		thread_count = jobs::get_thread_count();
+		threads = std::make_unique<thread_arena_t[]>(thread_count);
+	}
+
+	frame.reset();
+	for (unsigned i = 0; i < thread_count; i++)
+		threads[i].arena.reset();
+}
+
+render::frame::memory_t& render::frame::get_memory(void)
+{
+	return packets[recording].mem;
+}
+
+void render::frame::record(draw_t *draw, jobs::job_t *geometry)
+{
+	packet_t& p = packets[recording];
+
+	if (geometry) {
+		p.geometry.push_back(geometry);
+		jobs::submit(geometry);
+	}
+	p.draws.push_back(draw);
 }
 
-int render::init(int w, int h)
+/* Resize render buffers to the current resolution scale */
+static int apply_resolution_scale(void)
 {
-	if (display::init(w, h))
+	auto [w, h] = display::get_resolution();
+	int rw = std::max(1, (int)std::lround(w * resolution_scale));
+	int rh = std::max(1, (int)std::lround(h * resolution_scale));
+
+	if (rw == render_width && rh == render_height)
+		return 0;
+
+	/* the previous frame may still use the buffers */
+	wait_raster();
+
+	if (render::zbuf::init(rw, rh, render::zbuf::get_format()))
+		return 1;
+	if (render::is_msaa_enabled() && render::msaa::init(rw, rh))
+		return 1;
+	if (rw != w || rh != h)
+		colorbuffer.resize(display::tile_size(w, h));
+
+	render_width = rw;
+	render_height = rh;
+	set_viewport(rw, rh);
+	update_MVP();
+	return 0;
+}
+
+int render::init(int w, int h, bool headless)
+{
+	if (display::init(w, h, headless))
 		return 1;
 	if (zbuf::init(w, h)) {
 		display::release();
@@ -40,12 +320,13 @@ int render::init(int w, int h)
 	view.identity();
 	projection.identity();
 
-	viewport.identity();
-	viewport(0, 0) = w / 2.f;
-	viewport(0, 3) = w / 2.f;
+	packets[0].mem.reset();
+	packets[1].mem.reset();
 
-	viewport(1, 1) = (-h / 2.f);
-	viewport(1, 3) = h / 2.f;
+	resolution_scale = 1.f;
+	render_width = w;
+	render_height = h;
+	set_viewport(w, h);
 
 	update_MVP();
 	return 0;
@@ -53,21 +334,104 @@ int render::init(int w, int h)
 
 void render::release(void)
 {
+	wait_raster();
+	discard(packets[0]);
+	discard(packets[1]);
+	present_pending = false;
+
+	msaa::release();
+	msaa_enabled = false;
+	shadow::release();
+	shadow_enabled = false;
 	zbuf::release();
+	colorbuffer.resize(0);
+	colorbuffer.shrink_to_fit();
+	render_width = render_height = 0;
 	display::release();
 }
 
 void render::clear(void)
 {
-	display::clear();
-	zbuf::clear();
+	profile::frame();
+	textures::frame();
+	PROFILE_ZONE("render::clear");
+	frame_start = std::chrono::steady_clock::now();
+	apply_resolution_scale();
+
+	/* draws recorded since the last update() are cleared too */
+	discard(packets[recording]);
+	packets[recording].mem.reset();
+
+	/* with pipelining buffers are cleared by the raster job */
+	if (!pipelining_enabled)
+		clear_buffers(shadow_enabled);
 }
 
 int render::update(void)
 {
+	PROFILE_ZONE("render::update");
+	if (pipelining_enabled) {
+		int ret;
+
+		/* present the previous frame, it was rasterized while this one
+		 * was recorded
+		 */
+		ret = present_raster();
+		discard(packets[recording ^ 1]);
+
+		/* rasterize this frame once geometry of all its draws is done */
+		packet_t& p = packets[recording];
+		p.shadow = shadow_enabled;
+		raster_job = jobs::create(raster_packet, &p);
+		for (auto job : p.geometry)
+			jobs::depend(raster_job, job);
+		jobs::submit(raster_job);
+		present_pending = true;
+		recording ^= 1;
+
+		return ret;
+	}
+
+	resolve_buffers();
+
+	/* presentation may wait for vsync, don't count it */
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - frame_start;
+	resolution_scale = controller.update(elapsed.count(), resolution_scale);
+
 	return display::update();
 }
 
+int render::flush(void)
+{
+	return present_raster();
+}
+
+float render::get_resolution_scale(void)
+{
+	return resolution_scale;
+}
+
+void render::set_resolution_scale(float scale)
+{
+	resolution_scale = std::clamp(scale, 0.01f, 1.f);
+}
+
+void render::set_target_frame_time(float ms, float min_scale)
+{
+	controller.target_ms = ms;
+	controller.min_scale = std::clamp(min_scale, 0.01f, 1.f);
+	controller.avg_ms = 0.f;
+}
+
+display::surface_t render::get_surface(void)
+{
+	auto [w, h] = display::get_resolution();
+	if (render_width == w && render_height == h)
+		return display::get_surface();
+
+	return { colorbuffer.data(), render_width, render_height };
+}
+
 bool render::is_zbuf_enabled(void)
 {
 	return zbuf_enabled;
@@ -78,16 +442,266 @@ void render::zbuf_enable(bool en)
 	zbuf_enabled = en;
 }
 
+bool render::is_zbuf_write_enabled(void)
+{
+	return zbuf_write_enabled;
+}
+
+void render::zbuf_write_enable(bool en)
+{
+	zbuf_write_enabled = en;
+}
+
+bool render::is_lighting_enabled(void)
+{
+	return lighting_enabled;
+}
+
+void render::lighting_enable(bool en)
+{
+	lighting_enabled = en;
+}
+
+const vec3f_t& render::get_light_direction(void)
+{
+	return light_dir;
+}
+
+void render::set_light_direction(const vec3f_t& dir)
+{
+	light_dir = dir;
+	light_dir.normalize();
+	update_light();
+}
+
+float render::get_light_intensity(void)
+{
+	return light_intensity;
+}
+
+void render::set_light_intensity(float intensity)
+{
+	light_intensity = std::max(intensity, 0.f);
+}
+
+render::lighting_mode render::get_lighting_mode(void)
+{
+	return lighting;
+}
+
+void render::set_lighting_mode(lighting_mode mode)
+{
+	lighting = mode;
+}
+
+bool render::is_shadow_enabled(void)
+{
+	return shadow_enabled;
+}
+
+int render::shadow_enable(bool en, int size)
+{
+	if (en && size != shadow::get_surface().width) {
+		/* the previous frame and draws recorded to this one may use the
+		 * map
+		 */
+		wait_raster();
+		discard(packets[recording]);
+
+		if (shadow::init(size))
+			return 1;
+		shadow::clear();
+	}
+
+	shadow_enabled = en;
+	update_light();
+	return 0;
+}
+
+void render::set_shadow_bounds(const vec3f_t& center, float radius)
+{
+	shadow_center = center;
+	shadow_radius = radius;
+	update_light();
+}
+
+bool render::is_shadow_pcf_enabled(void)
+{
+	return shadow_pcf_enabled;
+}
+
+void render::shadow_pcf_enable(bool en)
+{
+	shadow_pcf_enabled = en;
+}
+
+bool render::is_fixed_point_enabled(void)
+{
+	return fixed_point_enabled;
+}
+
+void render::fixed_point_enable(bool en)
+{
+	fixed_point_enabled = en;
+}
+
+bool render::is_mipmapping_enabled(void)
+{
+	return mipmapping_enabled;
+}
+
+void render::mipmapping_enable(bool en)
+{
+	mipmapping_enabled = en;
+}
+
+float render::get_lod_bias(void)
+{
+	return lod_bias;
+}
+
+void render::set_lod_bias(float bias)
+{
+	lod_bias = bias;
+}
+
+bool render::is_msaa_enabled(void)
+{
+	return msaa_enabled;
+}
+
+int render::msaa_enable(bool en)
+{
+	if (en == msaa_enabled)
+		return 0;
+
+	/* the previous frame and draws recorded to this one use the buffers */
+	wait_raster();
+	discard(packets[recording]);
+
+	if (en) {
+		if (msaa::init(render_width, render_height))
+			return 1;
+		msaa::clear();
+	} else {
+		msaa::release();
+		zbuf::clear();
+	}
+
+	msaa_enabled = en;
+	return 0;
+}
+
+render::zbuf::format render::get_depth_format(void)
+{
+	return zbuf::get_format();
+}
+
+int render::set_depth_format(zbuf::format fmt)
+{
+	if (fmt == zbuf::get_format())
+		return 0;
+
+	/* the previous frame and draws recorded to this one use the buffer */
+	wait_raster();
+	discard(packets[recording]);
+
+	if (zbuf::init(render_width, render_height, fmt))
+		return 1;
+	zbuf::clear();
+
+	update_depth_projection();
+	return 0;
+}
+
+void render::set_depth_range(float near, float far)
+{
+	if (!(near > 0.f && far > near))
+		return;
+
+	depth_near = near;
+	depth_far = far;
+	update_depth_projection();
+}
+
+float render::get_near_w(void)
+{
+	return depth_near / camera_distance;
+}
+
+bool render::is_pipelining_enabled(void)
+{
+	return pipelining_enabled;
+}
+
+void render::pipelining_enable(bool en)
+{
+	if (en == pipelining_enabled)
+		return;
+
+	if (!en) {
+		/* show the last rasterized frame, drop the one being recorded */
+		present_raster();
+		discard(packets[0]);
+		discard(packets[1]);
+	}
+
+	pipelining_enabled = en;
+}
+
+const mat4x4f_t& render::get_mvp(void)
+{
+	return MVP;
+}
+
+const mat4x4f_t& render::get_model(void)
+{
+	return model;
+}
+
+const mat3x3f_t& render::get_normal_matrix(void)
+{
+	return normal_matrix;
+}
+
+const mat4x4f_t& render::get_light_mvp(void)
+{
+	return light_MVP;
+}
+
+render::cull_mode render::get_cull_mode(void)
+{
+	return cull;
+}
+
+void render::set_cull_mode(cull_mode mode)
+{
+	cull = mode;
+}
+
+vec4f_t render::project_homogeneous(const vec3f_t& v)
+{
+	return MVP * mat4x1f_t{ v.x, v.y, v.z, 1.f };
+}
+
 vec3f_t render::project_to_screen(const vec3f_t& v)
 {
-	vec4f_t r = MVP * mat4x1f_t{ v.x, v.y, v.z, 1.f };
+	vec4f_t r = project_homogeneous(v);
 	r /= r.w;
 	return r;
 }
 
+void render::project_homogeneous(const vec3f_t *v, vec4f_t *out, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		out[i] = { v[i].x, v[i].y, v[i].z, 1.f };
+
+	transform(MVP, out, out, n);
+}
+
 vec3f_t render::project_to_world(const vec3f_t & v)
 {
-	return model * mat4x1f_t(v.x, v.y, v.z, 0.f);
+	return normal_matrix * mat3x1f_t{ v.x, v.y, v.z };
 }
 
 void render::lookat(const vec3f_t& eye, const vec3f_t& at, const vec3f_t& up)
@@ -104,9 +718,10 @@ void render::lookat(const vec3f_t& eye, const vec3f_t& at, const vec3f_t& up)
 		view(2, i) = forward[i];
 	}
 
-	projection(3, 2) = -1.f / (eye - at).length();
+	camera_distance = (eye - at).length();
+	projection(3, 2) = -1.f / camera_distance;
 
-	update_MVP();
+	update_depth_projection();
 }
 
 void render::model_mat::identity(void)
@@ -1,20 +1,214 @@
 #ifndef RENDER_RENDER_H_
 #define RENDER_RENDER_H_
 
+#include <display/display.h>
 #include "line.h"
 #include "triangle.h"
 #include "zbuf.h"
 
 namespace render {
 
-int init(int w = 600, int h = 600);
+/** Initialize renderer and display.
+ *
+ * @param w, h: display resolution.
+ * @param headless: render to memory without a window (see display::init()).
+ * @return 0 on success.
+ */
+int init(int w = 600, int h = 600, bool headless = false);
 void release(void);
 void clear(void);
 int update(void);
 
+/** Enable/disable depth test. Enabled by default. */
 bool is_zbuf_enabled(void);
 void zbuf_enable(bool en);
 
+/** Enable/disable depth buffer writes. Enabled by default. */
+bool is_zbuf_write_enabled(void);
+void zbuf_write_enable(bool en);
+
+/** Enable/disable lighting. Enabled by default.
+ * If lighting is disabled triangles are drawn with full intensity.
+ */
+bool is_lighting_enabled(void);
+void lighting_enable(bool en);
+
+/** Set direction to the light in world space. (0, 0, 1) by default: the
+ * light shines from the camera.
+ *
+ * @param dir: the direction, normalized by the call.
+ */
+const vec3f_t& get_light_direction(void);
+void set_light_direction(const vec3f_t& dir);
+
+/** Set light intensity, 1 by default. Diffuse light is multiplied by the
+ * intensity and saturates at full brightness.
+ */
+float get_light_intensity(void);
+void set_light_intensity(float intensity);
+
+/** Select where diffuse light is calculated. Per pixel by default. */
+lighting_mode get_lighting_mode(void);
+void set_lighting_mode(lighting_mode mode);
+
+/** Enable/disable shadow mapping. Disabled by default.
+ * Shadow casters are drawn to a shadow map by shadow_triangle() calls, lit
+ * triangles drawn after them look the map up. The map is allocated by the
+ * first call enabling shadows and kept until release(). Resizing the map drops
+ * draws recorded since the last clear().
+ *
+ * @param size: the shadow map is size x size texels.
+ * @return 0 on success.
+ */
+bool is_shadow_enabled(void);
+int shadow_enable(bool en, int size = 1024);
+
+/** Set a sphere the shadow map covers. Geometry outside of it is lit.
+ *
+ * @param center: center of the sphere in world space.
+ * @param radius: radius of the sphere.
+ */
+void set_shadow_bounds(const vec3f_t& center, float radius);
+
+/** Enable/disable percentage closer filtering of shadows. Disabled by
+ * default. Filtering softens shadow edges at the cost of 9 shadow map lookups
+ * per pixel instead of one.
+ */
+bool is_shadow_pcf_enabled(void);
+void shadow_pcf_enable(bool en);
+
+/** Enable/disable fixed point rasterization. Disabled by default.
+ * Vertices are snapped to 1/256 pixel and coverage is calculated with integer
+ * arithmetic. Triangles sharing an edge never overlap or leave cracks.
+ */
+bool is_fixed_point_enabled(void);
+void fixed_point_enable(bool en);
+
+/** Enable/disable mipmapping. Enabled by default.
+ * Textures of models are sampled at the mip level matching the footprint of
+ * a pixel, taken from derivatives of texture coordinates in 2x2 quads.
+ * Disabled, the mip level of the model is sampled everywhere: sharper, but
+ * minified textures alias and read more memory.
+ */
+bool is_mipmapping_enabled(void);
+void mipmapping_enable(bool en);
+
+/** Set bias of the mip level of detail, 0 by default. Negative values
+ * select finer levels.
+ */
+float get_lod_bias(void);
+void set_lod_bias(float bias);
+
+/** Enable/disable 4x multisample anti-aliasing. Disabled by default.
+ * Coverage and depth are tested per sample, but a pixel is shaded once.
+ * Sample buffers are allocated when MSAA is enabled and released when it's
+ * disabled.
+ *
+ * @return 0 on success.
+ */
+bool is_msaa_enabled(void);
+int msaa_enable(bool en);
+
+/** Select depth buffer format. float32 by default.
+ * 16 and 24-bit formats halve and quarter depth buffer traffic. They keep
+ * depth normalized between the near and far planes (see set_depth_range()),
+ * geometry beyond the far plane is discarded. reversed_float32 keeps
+ * near / distance: float precision is spent evenly over the distance range.
+ * The formats other than float32 need a perspective projection (lookat()).
+ * MSAA sample buffers keep float depth in any format.
+ *
+ * @note Draws recorded since the last clear() are dropped.
+ * @return 0 on success.
+ */
+zbuf::format get_depth_format(void);
+int set_depth_format(zbuf::format fmt);
+
+/** Set distances from the camera to the near and far planes of the depth
+ * formats. 0.1 and 100 by default. Ignored unless 0 < near < far.
+ */
+void set_depth_range(float near, float far);
+
+/** Get homogeneous w of the near plane of the depth range
+ * A point with a smaller w is closer to the camera than the near plane (or
+ * behind it if w <= 0). Primitives clipped to this w get the same depth in
+ * every depth format.
+ */
+float get_near_w(void);
+
+/** Set internal render resolution relative to the display one.
+ * Scale 1 renders right to the display frame buffer. With a lower scale
+ * frames are rendered to an internal buffer and upscaled to the display by
+ * update(). The scale takes effect at the next clear().
+ *
+ * @param scale: (0, 1], 1 by default.
+ */
+float get_resolution_scale(void);
+void set_resolution_scale(float scale);
+
+/** Enable/disable dynamic resolution scaling.
+ * update() measures render time of a frame (from clear() to the display
+ * update) and adjusts resolution scale to hold the target frame time.
+ *
+ * @param ms: target frame time in milliseconds, e.g. 16.6. 0 disables scaling
+ * and keeps the current scale.
+ * @param min_scale: the lowest resolution scale allowed.
+ */
+void set_target_frame_time(float ms, float min_scale = 0.5f);
+
+/** Get color surface to draw to
+ * It's either the display frame buffer or the internal one with resolution
+ * scaling. The surface is valid until the next clear() call.
+ */
+display::surface_t get_surface(void);
+
+/** Select which faces are discarded. Back faces are culled by default. */
+cull_mode get_cull_mode(void);
+void set_cull_mode(cull_mode mode);
+
+/** Enable/disable pipelined rendering. Disabled by default.
+ * Draw calls are recorded to a frame packet and their geometry is processed
+ * by jobs while the previous frame is rasterized. update() presents the
+ * previous frame and queues rasterization of the recorded one, so frames are
+ * shown with one frame latency.
+ *
+ * @note Data passed to draw calls by reference (model arrays, textures) must
+ * be valid until the next update() call.
+ */
+bool is_pipelining_enabled(void);
+void pipelining_enable(bool en);
+
+/** Show a frame still in flight
+ * With pipelining the last frame is presented by the next update() only. Call
+ * this when no more frames are going to be drawn for a while. Does nothing if
+ * pipelining is disabled.
+ *
+ * @return 0 on success.
+ */
+int flush(void);
+
+/** Get the product of viewport, projection, view and model matrices */
+const mat4x4f_t& get_mvp(void);
+
+/** Get the model matrix */
+const mat4x4f_t& get_model(void);
+
+/** Get the normal matrix: the inverse transpose of the model rotation and
+ * scaling. It transforms normals to world space, they stay perpendicular to
+ * surfaces under non-uniform scaling.
+ */
+const mat3x3f_t& get_normal_matrix(void);
+
+/** Get the product of the shadow map projection and model matrices */
+const mat4x4f_t& get_light_mvp(void);
+
+/** Project a geometric vertex to homogeneous screen space.
+ * Apply model, view and projection transformations without perspective
+ * divide. Divide the result by w to get screen coordinates.
+ *
+ * @param v: model vertex
+ */
+vec4f_t project_homogeneous(const vec3f_t& v);
+
 /** Project a geometric vertex to screen space.
  * Apply model, view and projection transformations
  *
@@ -22,9 +216,19 @@ void zbuf_enable(bool en);
  */
 vec3f_t project_to_screen(const vec3f_t& v);
 
-/** Project a vector from model space to world space.
- * Apply model transformation. Used to convert a normal vector from model space
- * to world space (for lighting calculation).
+/** Project an array of geometric vertices to homogeneous coordinates.
+ * Batched version of project_homogeneous(). The vertex is behind the camera
+ * if w <= 0, clip primitives against the near plane before perspective divide.
+ *
+ * @param v: model vertices
+ * @param out: homogeneous vertices
+ * @param n: number of vertices
+ */
+void project_homogeneous(const vec3f_t *v, vec4f_t *out, size_t n);
+
+/** Project a normal vector from model space to world space.
+ * Apply the normal matrix (for lighting calculation). The result isn't
+ * normalized.
  *
  * @param v: a vector
  */
@@ -0,0 +1,161 @@
+#include "scaler.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+#include <jobs/jobs.h>
+#include <simd.h>
+
+/* Horizontal sampling tables, rebuilt when the surface sizes change */
+static int table_src_w;
+static int table_dst_w;
+/* column offsets (see display::tile_column()) of the left and right source
+ * pixels
+ */
+static std::vector<std::array<size_t, 2>> src_x;
+/* weights of the left and right source pixels, 4 channels each */
+static std::vector<std::array<uint16_t, 8>> weight_x;
+
+/* Map a destination coordinate to the left (top) source pixel and the weight
+ * of the right (bottom) one in 1/256 units
+ */
+static void map(int d, int src_size, int dst_size, int& s, uint16_t& w)
+{
+	float f = ((float)d + 0.5f) * (float)src_size / (float)dst_size - 0.5f;
+	if (f < 0.f)
+		f = 0.f;
+
+	s = (int)f;
+	w = (uint16_t)std::lround((f - (float)s) * 256.f);
+	if (s >= src_size - 1) {
+		s = src_size - 1;
+		w = 0;
+	}
+}
+
+static void build_tables(int src_w, int dst_w)
+{
+	if (src_w == table_src_w && dst_w == table_dst_w)
+		return;
+
+	src_x.resize(dst_w);
+	weight_x.resize(dst_w);
+	for (int x = 0; x < dst_w; x++) {
+		int s;
+		uint16_t w;
+		map(x, src_w, dst_w, s, w);
+		src_x[x] = { display::tile_column(s), display::tile_column(std::min(s + 1, src_w - 1)) };
+		weight_x[x] = { (uint16_t)(256 - w), (uint16_t)(256 - w), (uint16_t)(256 - w), (uint16_t)(256 - w), w, w, w, w };
+	}
+
+	table_src_w = src_w;
+	table_dst_w = dst_w;
+}
+
+/* Interpolate a row. a*(256 - w) + b*w never exceeds 255*256, so all the math
+ * is done in unsigned 16 bit lanes. Rows are tiled: the left and right pixels
+ * are adjacent in memory within a tile only, they are loaded one by one.
+ */
+static void upscale_row(const uint32_t *r0, const uint32_t *r1, uint16_t fy,
+	uint32_t *dst, int n)
+{
+#if defined(SIMD_SSE)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i wy0 = _mm_set1_epi16((short)(256 - fy));
+	const __m128i wy1 = _mm_set1_epi16((short)fy);
+
+	auto load = [zero](const uint32_t *r, const std::array<size_t, 2>& i) {
+		return _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int)r[i[0]]),
+			_mm_cvtsi32_si128((int)r[i[1]])), zero);
+	};
+
+	for (int x = 0; x < n; x++) {
+		/* left and right pixels of both rows */
+		__m128i a = load(r0, src_x[x]);
+		__m128i b = load(r1, src_x[x]);
+		__m128i v = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, wy0), _mm_mullo_epi16(b, wy1)), 8);
+		__m128i h = _mm_mullo_epi16(v, _mm_loadu_si128((const __m128i *)weight_x[x].data()));
+		h = _mm_srli_epi16(_mm_add_epi16(h, _mm_srli_si128(h, 8)), 8);
+		dst[display::tile_column(x)] = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(h, h));
+	}
+#elif defined(SIMD_NEON)
+	const uint16x8_t wy0 = vdupq_n_u16((uint16_t)(256 - fy));
+	const uint16x8_t wy1 = vdupq_n_u16(fy);
+
+	auto load = [](const uint32_t *r, const std::array<size_t, 2>& i) {
+		return vmovl_u8(vcreate_u8(r[i[0]] | (uint64_t)r[i[1]] << 32));
+	};
+
+	for (int x = 0; x < n; x++) {
+		uint16x8_t a = load(r0, src_x[x]);
+		uint16x8_t b = load(r1, src_x[x]);
+		uint16x8_t v = vshrq_n_u16(vmlaq_u16(vmulq_u16(a, wy0), b, wy1), 8);
+		uint16x8_t h = vmulq_u16(v, vld1q_u16(weight_x[x].data()));
+		uint16x4_t s = vshr_n_u16(vadd_u16(vget_low_u16(h), vget_high_u16(h)), 8);
+		dst[display::tile_column(x)] = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(s, s))), 0);
+	}
+#else
+	for (int x = 0; x < n; x++) {
+		const uint8_t *a0 = (const uint8_t *)(r0 + src_x[x][0]);
+		const uint8_t *a1 = (const uint8_t *)(r0 + src_x[x][1]);
+		const uint8_t *b0 = (const uint8_t *)(r1 + src_x[x][0]);
+		const uint8_t *b1 = (const uint8_t *)(r1 + src_x[x][1]);
+		const uint16_t *wx = weight_x[x].data();
+		uint8_t *d = (uint8_t *)(dst + display::tile_column(x));
+
+		for (int c = 0; c < 4; c++) {
+			unsigned left = (a0[c] * (256u - fy) + b0[c] * fy) >> 8;
+			unsigned right = (a1[c] * (256u - fy) + b1[c] * fy) >> 8;
+			d[c] = (uint8_t)((left * wx[0] + right * wx[4]) >> 8);
+		}
+	}
+#endif
+}
+
+void render::scaler::upscale(const display::surface_t& src, const display::surface_t& dst)
+{
+	/* rows per job */
+	constexpr size_t GRAIN = 16;
+
+	build_tables(src.width, dst.width);
+
+	jobs::parallel_for(dst.height, GRAIN, [&](size_t begin, size_t end) {
+		for (int y = (int)begin; y < (int)end; y++) {
+			int sy;
+			uint16_t fy;
+			map(y, src.height, dst.height, sy, fy);
+
+			const uint32_t *r0 = src.row(sy);
+			const uint32_t *r1 = src.row(std::min(sy + 1, src.height - 1));
+			upscale_row(r0, r1, fy, dst.row(y), dst.width);
+		}
+	});
+}
+
+float render::scaler::controller_t::update(float frame_ms, float scale)
+{
+	/* scale steps, 1/16 of the display resolution */
+	constexpr float STEPS = 16.f;
+
+	if (target_ms <= 0.f)
+		return scale;
+
+	avg_ms = avg_ms > 0.f ? avg_ms + (frame_ms - avg_ms) * 0.25f : frame_ms;
+
+	float ratio = target_ms / avg_ms;
+	if (ratio >= 0.95f && ratio <= 1.15f)
+		return scale;
+
+	/* always step down when too slow, grow conservatively */
+	float wanted = scale * std::sqrt(ratio) * STEPS;
+	wanted = (ratio < 1.f ? std::floor(wanted) : std::round(wanted)) / STEPS;
+	wanted = std::clamp(wanted, min_scale, 1.f);
+	if (wanted == scale)
+		return scale;
+
+	/* predict the frame time at the new scale, don't wait for the average
+	 * to settle
+	 */
+	avg_ms *= (wanted * wanted) / (scale * scale);
+	return wanted;
+}
@@ -0,0 +1,37 @@
+#ifndef RENDER_SCALER_H_
+#define RENDER_SCALER_H_
+
+#include <display/display.h>
+
+namespace render::scaler {
+
+/** Upscale a surface to another one with bilinear filter
+ * Pixel centers of both surfaces are aligned, the border is clamped.
+ *
+ * @param src: source surface.
+ * @param dst: destination surface.
+ */
+void upscale(const display::surface_t& src, const display::surface_t& dst);
+
+/** Frame time controller
+ * Adjust resolution scale to fit render time of a frame into the target. Most
+ * of the frame time is proportional to the number of pixels, so the scale
+ * changes by a square root of the time ratio. The scale is quantized and
+ * changes only when the time is out of the [0.95, 1.15] range of the target
+ * to avoid a resize on every frame.
+ */
+struct controller_t {
+	float target_ms = 0.f; /**< 0 - disabled */
+	float min_scale = 0.5f;
+	float avg_ms = 0.f;    /**< smoothed frame time */
+
+	/** Feed time of a frame rendered with scale
+	 *
+	 * @return new scale.
+	 */
+	float update(float frame_ms, float scale);
+};
+
+} /* namespace render::scaler */
+
+#endif /* RENDER_SCALER_H_ */
@@ -0,0 +1,264 @@
+#ifndef RENDER_SHADER_H_
+#define RENDER_SHADER_H_
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include <model/model.h>
+#include <render/color.h>
+#include <render/pipeline.h>
+#include <render/shadow.h>
+#include <render/texture.h>
+#include <vector.h>
+
+namespace render {
+
+/** Shadow lookup of the built-in shader */
+enum class shadow_mode {
+	none, /**< No shadows */
+	hard, /**< A single shadow map texel */
+	pcf,  /**< Percentage closer filtering of 3x3 texels */
+};
+
+/* A varying the shader doesn't need: no space, nothing to interpolate */
+struct unused_t {
+	unused_t operator+(const unused_t&) const { return {}; }
+	unused_t operator*(float) const { return {}; }
+};
+
+/* Varyings of the built-in shader, unused ones are unused_t */
+template <typename LIGHT, typename TEX, typename SHADOW_POS>
+struct standard_varyings_t {
+	LIGHT light; /**< Normal in world space or diffuse intensity */
+	TEX tex;     /**< Texture coordinates */
+	[[no_unique_address]] SHADOW_POS shadow_pos; /**< Position in shadow map space */
+
+	standard_varyings_t operator+(const standard_varyings_t& rhs) const
+	{
+		return { light + rhs.light, tex + rhs.tex, shadow_pos + rhs.shadow_pos };
+	}
+
+	standard_varyings_t operator*(float scalar) const
+	{
+		return { light * scalar, tex * scalar, shadow_pos * scalar };
+	}
+};
+
+/** Built-in shader
+ * Texture (or white color if TEXTURED is false) modulated by diffuse color
+ * and diffuse light intensity (or full intensity if LIT is false). Lit
+ * pixels in shadow get no diffuse light. With per-vertex lighting the
+ * intensity is calculated at vertices and interpolated, a normal isn't
+ * interpolated and normalized per pixel. A MIPMAPPED shader is a quad shader
+ * sampling the level of mips matching derivatives of texture coordinates.
+ */
+template <bool TEXTURED, bool LIT, shadow_mode SHADOW = shadow_mode::none,
+	lighting_mode LIGHTING = lighting_mode::per_pixel, bool MIPMAPPED = false>
+struct standard_shader {
+	static constexpr bool PER_VERTEX = LIGHTING == lighting_mode::per_vertex;
+	static_assert(TEXTURED || !MIPMAPPED, "mip levels of no texture");
+
+	using varyings_t = standard_varyings_t<
+		std::conditional_t<LIT, std::conditional_t<PER_VERTEX, float, vec3f_t>, unused_t>,
+		std::conditional_t<TEXTURED, vec2f_t, unused_t>,
+		std::conditional_t<LIT && SHADOW != shadow_mode::none, vec3f_t, unused_t>>;
+
+	texture_t texture = {};
+	vec3f_t diffuse{ 1.f, 1.f, 1.f };
+	mip_chain_t mips = {};
+	float lod_bias = get_lod_bias();
+	/* Transformations are copied when the shader is created: with pipelining
+	 * the vertex stage runs while the next frame changes them.
+	 */
+	mat4x4f_t mvp = get_mvp();
+	mat3x3f_t normal = get_normal_matrix();
+	mat4x4f_t light_mvp = get_light_mvp();
+	vec3f_t light_dir = get_light_direction();
+	float light_intensity = get_light_intensity();
+	shadow::sampler_t shadow = shadow::get_sampler();
+
+	vec4f_t vertex(const Vertex& in, varyings_t& out) const
+	{
+		if constexpr (LIT) {
+			vec3f_t n = normal * mat3x1f_t{ in.norm.x, in.norm.y, in.norm.z };
+			if constexpr (PER_VERTEX)
+				out.light = n.normalize() * light_dir;
+			else
+				out.light = n;
+		}
+		if constexpr (TEXTURED)
+			out.tex = in.tex;
+		if constexpr (LIT && SHADOW != shadow_mode::none)
+			out.shadow_pos = light_mvp * mat4x1f_t{ in.v.x, in.v.y, in.v.z, 1.f };
+		return mvp * mat4x1f_t{ in.v.x, in.v.y, in.v.z, 1.f };
+	}
+
+	bool fragment(const varyings_t& in, uint32_t& color) const requires (!MIPMAPPED)
+	{
+		return shade(in, texture, color);
+	}
+
+	bool fragment(const quad_t<varyings_t>& in, uint32_t& color) const requires MIPMAPPED
+	{
+		return shade(in.in(), mips.select(in.ddx().tex, in.ddy().tex, lod_bias), color);
+	}
+
+	/* Shade a pixel, the texture is sampled from image */
+	bool shade(const varyings_t& in, const texture_t& image, uint32_t& color) const
+	{
+		/* calculate light intensity */
+		float intensity = 1.f;
+		if constexpr (LIT) {
+			float cos_angle;
+			if constexpr (PER_VERTEX) {
+				cos_angle = in.light;
+			} else {
+				vec3f_t n = in.light;
+				n.normalize();
+				cos_angle = n * light_dir;
+			}
+			intensity = std::max(cos_angle, 0.f);
+
+			/* back faces are dark anyway, don't look them up */
+			if constexpr (SHADOW == shadow_mode::hard) {
+				if (intensity > 0.f)
+					intensity *= shadow.lit(in.shadow_pos, cos_angle);
+			} else if constexpr (SHADOW == shadow_mode::pcf) {
+				if (intensity > 0.f)
+					intensity *= shadow.lit_pcf(in.shadow_pos, cos_angle);
+			}
+			/* a bright light saturates */
+			intensity = std::min(intensity * light_intensity, 1.f);
+		}
+
+		/* calculate color */
+		if constexpr (TEXTURED) {
+			uint32_t t = image(in.tex.u, in.tex.v);
+			float r = intensity * diffuse.x * get_r(t);
+			float g = intensity * diffuse.y * get_g(t);
+			float b = intensity * diffuse.z * get_b(t);
+
+			color = make_color(r, g, b);
+		} else {
+			color = make_color(intensity * diffuse.x * 255.f, intensity * diffuse.y * 255.f,
+				intensity * diffuse.z * 255.f);
+		}
+
+		return true;
+	}
+};
+
+/** Built-in depth-only shader
+ * Renders positions to a depth target: a shadow map or the depth buffer for
+ * a depth prepass. See depth_only_shader.
+ */
+struct depth_shader {
+	struct varyings_t {
+		varyings_t operator+(const varyings_t&) const { return {}; }
+		varyings_t operator*(float) const { return {}; }
+	};
+
+	static constexpr bool depth_only = true;
+
+	zbuf::surface_t target = zbuf::get_surface();
+	mat4x4f_t mvp = get_mvp();
+
+	vec4f_t vertex(const Vertex& in, varyings_t&) const
+	{
+		return mvp * mat4x1f_t{ in.v.x, in.v.y, in.v.z, 1.f };
+	}
+
+	bool fragment(const varyings_t&, uint32_t&) const
+	{
+		return false;
+	}
+};
+
+/** Render a triangle in model coordinates with a custom shader
+ * Vertices passed counter clockwise.
+ *
+ * @param s: shader to process vertices and fragments with.
+ * @param v0: A triangle vertex
+ * @param v1: A triangle vertex
+ * @param v2: A triangle vertex
+ */
+template <shader S>
+void triangle(const S& s, const Vertex& v0, const Vertex& v1, const Vertex& v2)
+{
+	if (is_pipelining_enabled()) {
+		pipeline::draw(s, 1, [v0, v1, v2](size_t, Vertex v[3]) {
+			v[0] = v0;
+			v[1] = v1;
+			v[2] = v2;
+		});
+		return;
+	}
+
+	pipeline::raster_table<S>[pipeline::get_state(s)](s, v0, v1, v2);
+}
+
+/** Render triangles with a custom shader
+ *
+ * @param s: shader to process vertices and fragments with.
+ * @param faces: an array of faces.
+ * @param vertices: an array of vertex coordinates.
+ * @param normals: an array of normal coordinates.
+ * @param texture_uv: an array of texture coordinates.
+ * @param first: the first face to draw.
+ * @param count: faces to draw, up to the end by default.
+ *
+ * @note The function doesn't check if input arrays are valid.
+ */
+template <shader S>
+void triangle(const S& s, const std::vector<::model_t::Face>& faces,
+	const std::vector<std::vector<float>>& vertices,
+	const std::vector<std::vector<float>>& normals,
+	const std::vector<std::vector<float>>& texture_uv,
+	size_t first = 0, size_t count = SIZE_MAX)
+{
+	count = std::min(count, faces.size() - first);
+	pipeline::draw(s, count, [&, first](size_t n, Vertex v[3]) {
+		const auto& face = faces[first + n];
+
+		for (size_t i = 0; i < 3; i++)
+			v[i].v = { vertices[(size_t)face.v_idx[i] - 1][0],
+				vertices[(size_t)face.v_idx[i] - 1][1],
+				vertices[(size_t)face.v_idx[i] - 1][2] };
+
+		for (size_t i = 0; i < 3; i++)
+			v[i].norm = { normals[(size_t)face.n_idx[i] - 1][0],
+				normals[(size_t)face.n_idx[i] - 1][1],
+				normals[(size_t)face.n_idx[i] - 1][2] };
+
+		for (size_t i = 0; i < 3; i++)
+			v[i].tex = { texture_uv[(size_t)face.tex_idx[i] - 1][0],
+				texture_uv[(size_t)face.tex_idx[i] - 1][1] };
+	});
+}
+
+/** Render triangles with a depth-only shader
+ * Only vertex positions are fetched.
+ *
+ * @param s: shader to process vertices with.
+ * @param faces: an array of faces.
+ * @param vertices: an array of vertex coordinates.
+ *
+ * @note The function doesn't check if input arrays are valid.
+ */
+template <depth_only_shader S>
+void triangle(const S& s, const std::vector<::model_t::Face>& faces,
+	const std::vector<std::vector<float>>& vertices)
+{
+	pipeline::draw(s, faces.size(), [&](size_t n, Vertex v[3]) {
+		const auto& face = faces[n];
+
+		for (size_t i = 0; i < 3; i++)
+			v[i].v = { vertices[(size_t)face.v_idx[i] - 1][0],
+				vertices[(size_t)face.v_idx[i] - 1][1],
+				vertices[(size_t)face.v_idx[i] - 1][2] };
+	});
+}
+
+} /* namespace render */
+
+#endif /* RENDER_SHADER_H_ */
@@ -0,0 +1,81 @@
+#include "shadow.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <jobs/jobs.h>
+
+/* Points cleared by a job */
+constexpr size_t CLEAR_GRAIN = 1 << 16;
+
+static int map_size;
+static std::vector<float> map;
+/* world space to map space */
+static mat4x4f_t matrix;
+/* world units per texel */
+static float texel = 1.f;
+
+int render::shadow::init(int size)
+{
+	if (size <= 0)
+		return 1;
+
+	map.resize(display::tile_size(size, size));
+	map_size = size;
+	return 0;
+}
+
+void render::shadow::release(void)
+{
+	map.resize(0);
+	map.shrink_to_fit();
+	map_size = 0;
+}
+
+void render::shadow::clear(void)
+{
+	jobs::parallel_for(map.size(), CLEAR_GRAIN, [](size_t begin, size_t end) {
+		std::fill(map.begin() + begin, map.begin() + end, std::numeric_limits<float>::lowest());
+	});
+}
+
+render::zbuf::surface_t render::shadow::get_surface(void)
+{
+	return { map.data(), map_size, map_size };
+}
+
+void render::shadow::set_projection(const vec3f_t& dir, const vec3f_t& center, float radius)
+{
+	vec3f_t forward = dir;
+	forward.normalize();
+
+	/* any up vector not parallel to the light */
+	vec3f_t up = std::abs(forward.y) < 0.99f ? vec3f_t{ 0.f, 1.f, 0.f } : vec3f_t{ 0.f, 0.f, 1.f };
+	vec3f_t right = (up ^ forward).normalize();
+	up = forward ^ right;
+
+	/* the sphere maps to the whole map, y goes down like on the screen */
+	float scale = map_size / (2.f * radius);
+	float half = map_size / 2.f;
+
+	matrix.identity();
+	for (size_t i = 0; i < 3; i++) {
+		matrix(0, i) = scale * right[i];
+		matrix(1, i) = -scale * up[i];
+		matrix(2, i) = forward[i];
+	}
+	matrix(0, 3) = half - scale * (right * center);
+	matrix(1, 3) = half + scale * (up * center);
+	matrix(2, 3) = -(forward * center);
+
+	texel = 1.f / scale;
+}
+
+const mat4x4f_t& render::shadow::get_matrix(void)
+{
+	return matrix;
+}
+
+render::shadow::sampler_t render::shadow::get_sampler(void)
+{
+	return { map.data(), map_size, texel };
+}
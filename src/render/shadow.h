@@ -0,0 +1,131 @@
+#ifndef RENDER_SHADOW_H_
+#define RENDER_SHADOW_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <matrix.h>
+#include <render/zbuf.h>
+#include <vector.h>
+
+/* Shadow map of the directional light
+ *
+ * The map is a depth buffer rendered from the light with an orthographic
+ * projection which covers a sphere of the scene. Map space: x, y in texels,
+ * z is the distance towards the light, so like in the depth buffer a greater
+ * z is closer.
+ */
+namespace render::shadow {
+
+/** Initialize the shadow map
+ *
+ * @param size: the map is size x size texels.
+ * @return 0 on success.
+ */
+int init(int size);
+
+/** Release the shadow map.
+ *
+ * @note It's safe to invoke the function if init() failed or has never been
+ * invoked.
+ */
+void release(void);
+
+/** Clear the shadow map: nothing casts a shadow */
+void clear(void);
+
+/** Get the shadow map as a depth surface to render casters to
+ * The surface is valid until release() or next init() call.
+ */
+zbuf::surface_t get_surface(void);
+
+/** Set the light projection
+ *
+ * @param dir: direction to the light.
+ * @param center: center of the sphere to cover, in world space.
+ * @param radius: radius of the sphere.
+ */
+void set_projection(const vec3f_t& dir, const vec3f_t& center, float radius);
+
+/** Get the matrix transforming world space to map space */
+const mat4x4f_t& get_matrix(void);
+
+/** Shadow map lookup, copied to shaders. The map is tiled like the depth
+ * buffer
+ */
+struct sampler_t {
+	const float *depth;
+	int size;
+	float texel; /**< texel size in world units */
+
+	/** Get depth offset against self shadowing
+	 * A surface at an angle to the map crosses depths of a texel and of its
+	 * neighbours looked up by the filter. The offset covers the slope.
+	 *
+	 * @param cos_angle: cosine of the angle between the surface normal and
+	 * the light direction.
+	 * @param texels: distance to the farthest texel looked up.
+	 */
+	float bias(float cos_angle, float texels) const
+	{
+		float c = std::max(cos_angle, 0.1f);
+		float slope = std::sqrt(1.f - c * c) / c;
+		return texel * (1.f + texels * slope);
+	}
+
+	/** Test a point in map space
+	 *
+	 * @param p: the point.
+	 * @param cos_angle: cosine of the angle between the surface normal and
+	 * the light direction, see bias().
+	 * @return 1 if the point is lit, 0 if it's in shadow. Points outside of
+	 * the map are lit.
+	 */
+	float lit(const vec3f_t& p, float cos_angle) const
+	{
+		/* also false for NaN. Truncation of positive p is floor() without
+		 * a library call
+		 */
+		if (!(p.x >= 0.f && p.y >= 0.f && p.x < (float)size && p.y < (float)size))
+			return 1.f;
+
+		int x = (int)p.x;
+		int y = (int)p.y;
+		float z = p.z + bias(cos_angle, 1.f);
+		return depth[display::tile_row(y, size) + display::tile_column(x)] > z ? 0.f : 1.f;
+	}
+
+	/** Percentage closer filtering: a fraction of 3x3 texels around the
+	 * point which are lit. See lit().
+	 */
+	float lit_pcf(const vec3f_t& p, float cos_angle) const
+	{
+		/* the kernel is outside of the map */
+		if (!(p.x >= -1.f && p.y >= -1.f && p.x < size + 1.f && p.y < size + 1.f))
+			return 1.f;
+
+		int cx = (int)(p.x + 1.f) - 1;
+		int cy = (int)(p.y + 1.f) - 1;
+		float z = p.z + bias(cos_angle, 2.f);
+		int shadowed = 0;
+
+		for (int y = cy - 1; y <= cy + 1; y++) {
+			if (y < 0 || y >= size)
+				continue;
+			const float *row = depth + display::tile_row(y, size);
+			for (int x = cx - 1; x <= cx + 1; x++) {
+				if (x >= 0 && x < size)
+					shadowed += row[display::tile_column(x)] > z;
+			}
+		}
+
+		return 1.f - shadowed * (1.f / 9.f);
+	}
+};
+
+/** Get a sampler of the shadow map */
+sampler_t get_sampler(void);
+
+} /* namespace render::shadow */
+
+#endif /* RENDER_SHADOW_H_ */
@@ -0,0 +1,77 @@
+#ifndef RENDER_TEXTURE_H_
+#define RENDER_TEXTURE_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector.h>
+
+namespace render {
+
+/** A texture image descriptor. The image itself is owned by the caller. */
+struct texture_t {
+	const uint32_t *color = nullptr; /**< colors in RGB888 format */
+	size_t w;
+	size_t h;
+
+	uint32_t operator()(size_t u, size_t v) const
+	{
+		assert(u < w);
+		assert(v < h);
+
+		return color[v * w + u];
+	}
+
+	uint32_t operator()(float u, float v) const
+	{
+		assert(u <= 1.f);
+		assert(v <= 1.f);
+
+		size_t ui = (size_t)(u * (w - 1));
+		size_t vi = (size_t)(v * (h - 1));
+
+		return color[vi * w + ui];
+	}
+};
+
+/** Mip levels of a texture, level[0] is the finest one and every next level
+ * is half the size of the previous one. The images are owned by the caller.
+ */
+struct mip_chain_t {
+	static constexpr unsigned MAX_LEVELS = 16;
+
+	texture_t level[MAX_LEVELS] = {};
+	unsigned count = 0;
+
+	/** Select the level for a pixel
+	 * The footprint of the pixel is the longer of its steps in texels of
+	 * level 0 to the next pixel right and down. Its log2 plus bias is
+	 * rounded to the nearest level, clamped to the available ones.
+	 *
+	 * @param ddx: change of texture coordinates to the next pixel right.
+	 * @param ddy: change of texture coordinates to the next pixel down.
+	 * @param bias: added to the level of detail, negative is sharper.
+	 */
+	const texture_t& select(const vec2f_t& ddx, const vec2f_t& ddy, float bias) const
+	{
+		assert(count > 0);
+
+		float w = (float)(level[0].w - 1);
+		float h = (float)(level[0].h - 1);
+		float x = ddx.u * w * ddx.u * w + ddx.v * h * ddx.v * h;
+		float y = ddy.u * w * ddy.u * w + ddy.v * h * ddy.v * h;
+
+		/* log2 of the length is half of log2 of the squared one */
+		float lod = 0.5f * std::log2(std::max(x, y)) + bias;
+		/* a zero footprint is -inf, NaN if varyings are */
+		if (!(lod >= 0.5f))
+			return level[0];
+		return level[(unsigned)std::min(lod + 0.5f, (float)(count - 1))];
+	}
+};
+
+} /* namespace render */
+
+#endif /* RENDER_TEXTURE_H_ */
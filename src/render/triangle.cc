@@ -1,191 +1,120 @@
 #include "triangle.h"
-#include <algorithm>
-#include <display/display.h>
-#include <matrix.h>
+#include <profile/profile.h>
 #include <render/render.h>
-#include <render/zbuf.h>
+#include <render/shader.h>
+#include <render/shadow.h>
+#include <render/texture.h>
+#include <textures/textures.h>
 
-/* return signed area of the triangle ABP multiplied by 2.
- * if point p at the right hand side of AB the result is positive. If the point
- * exactly on the line - 0, otherwise - negative.
- */
-static float edge_function(const vec3f_t& a, const vec3f_t& b, const vec3f_t& p)
+/* TODO: move to suitable place */
+static render::material_t material;
+
+void render::set_texture(const std::vector<uint32_t>& image, size_t width, size_t height)
 {
-	return (a.x - b.x) * (p.y - a.y) - (a.y - b.y) * (p.x - a.x);
+	material.texture.color = image.data();
+	material.texture.w = width;
+	material.texture.h = height;
+	material.mips.count = 0;
 }
 
-static uint8_t get_r(uint32_t color)
+void render::set_material(const material_t& m)
 {
-	return (color & 0xFF0000) >> 16;
+	material = m;
 }
 
-static uint8_t get_g(uint32_t color)
+const render::material_t& render::get_material(void)
 {
-	return (color & 0x00FF00) >> 8;
+	return material;
 }
 
-static uint8_t get_b(uint32_t color)
+unsigned render::pipeline::get_state(void)
 {
-	return color & 0x0000FF;
+	unsigned state = static_cast<unsigned>(get_cull_mode()) << CULL_SHIFT;
+	state |= static_cast<unsigned>(zbuf::get_format()) << FORMAT_SHIFT;
+
+	if (is_zbuf_enabled())
+		state |= DEPTH_TEST;
+	if (is_zbuf_write_enabled())
+		state |= DEPTH_WRITE;
+	if (is_fixed_point_enabled())
+		state |= FIXED_POINT;
+	if (is_msaa_enabled())
+		state |= MSAA;
+
+	return state;
 }
 
-static uint32_t make_color(float r, float g, float b)
+/* Pick the lit shader specialization matching shadow state */
+template <bool TEXTURED, render::lighting_mode LIGHTING, bool MIPMAPPED, typename FN>
+static void with_shadow_shader(FN&& fn)
 {
-	return (uint32_t)r << 16 | (uint32_t)g << 8 | (uint32_t)b;
+	using namespace render;
+
+	if (!is_shadow_enabled())
+		fn(standard_shader<TEXTURED, true, shadow_mode::none, LIGHTING, MIPMAPPED>{
+			material.texture, material.diffuse, material.mips });
+	else if (is_shadow_pcf_enabled())
+		fn(standard_shader<TEXTURED, true, shadow_mode::pcf, LIGHTING, MIPMAPPED>{
+			material.texture, material.diffuse, material.mips });
+	else
+		fn(standard_shader<TEXTURED, true, shadow_mode::hard, LIGHTING, MIPMAPPED>{
+			material.texture, material.diffuse, material.mips });
 }
 
-static uint32_t make_color(float intensity)
+/* Pick the lit shader specialization matching lighting mode and shadow state */
+template <bool TEXTURED, bool MIPMAPPED, typename FN>
+static void with_lit_shader(FN&& fn)
 {
-	uint32_t c = (uint32_t)(intensity * 255);
+	using namespace render;
 
-	return c << 16 | c << 8 | c;
+	if (get_lighting_mode() == lighting_mode::per_vertex)
+		with_shadow_shader<TEXTURED, lighting_mode::per_vertex, MIPMAPPED>(fn);
+	else
+		with_shadow_shader<TEXTURED, lighting_mode::per_pixel, MIPMAPPED>(fn);
 }
 
-/* TODO: move to suitable place */
-static struct {
-	const uint32_t *color = nullptr; /* colors in RGB888 format */
-	size_t w;
-	size_t h;
-
-	uint32_t operator()(size_t u, size_t v)
-	{
-		assert(u < w);
-		assert(v < h);
-
-		return color[v * w + u];
-	}
-
-	uint32_t operator()(float u, float v)
-	{
-		assert(u <= 1.f);
-		assert(v <= 1.f);
-
-		size_t ui = (size_t)(u * (w - 1));
-		size_t vi = (size_t)(v * (h - 1));
+/* Pick the textured shader specialization matching lighting mode and shadow
+ * state, MIPMAPPED selects the mip level of every pixel
+ */
+template <bool MIPMAPPED, typename FN>
+static void with_textured_shader(FN&& fn)
+{
+	using namespace render;
 
-		return color[vi * w + ui];
-	}
-} texture;
+	if (is_lighting_enabled())
+		with_lit_shader<true, MIPMAPPED>(fn);
+	else
+		fn(standard_shader<true, false, shadow_mode::none, lighting_mode::per_pixel, MIPMAPPED>{
+			material.texture, material.diffuse, material.mips });
+}
 
-void render::set_texture(const std::vector<uint32_t>& image, size_t width, size_t height)
+/* Pick the built-in shader specialization matching texture, mip levels,
+ * lighting mode and shadow state and pass it to fn.
+ */
+template <typename FN>
+static void with_standard_shader(FN&& fn)
 {
-	texture.color = image.data();
-	texture.w = width;
-	texture.h = height;
+	using namespace render;
+
+	if (material.texture.color != nullptr) {
+		if (is_mipmapping_enabled() && material.mips.count > 1)
+			with_textured_shader<true>(fn);
+		else
+			with_textured_shader<false>(fn);
+	} else {
+		if (is_lighting_enabled())
+			with_lit_shader<false, false>(fn);
+		else
+			fn(standard_shader<false, false>{ {}, material.diffuse });
+	}
 }
 
 void render::triangle(const Vertex& v0, const Vertex& v1, const Vertex& v2)
 {
-	auto [width, height] = display::get_resolution();
-
-	auto p0 = project_to_screen(v0.v);
-	auto p1 = project_to_screen(v1.v);
-	auto p2 = project_to_screen(v2.v);
-
-	/* bounding box */
-	vec2i_t bbox_min = { (int)std::min({p0.x, p1.x, p2.x}), (int)std::min({p0.y, p1.y, p2.y}) };
-	vec2i_t bbox_max = { (int)std::max({p0.x, p1.x, p2.x}), (int)std::max({p0.y, p1.y, p2.y}) };
-
-	bbox_min.x = std::max(bbox_min.x, 0);
-	bbox_min.x = std::min(bbox_min.x, width - 1);
-	bbox_min.y = std::max(bbox_min.y, 0);
-	bbox_min.y = std::min(bbox_min.y, height - 1);
-	bbox_max.x = std::max(bbox_max.x, 0);
-	bbox_max.x = std::min(bbox_max.x, width - 1);
-	bbox_max.y = std::max(bbox_max.y, 0);
-	bbox_max.y = std::min(bbox_max.y, height - 1);
-
-	for (int y = bbox_min.y; y <= bbox_max.y; y++) {
-		/* TODO: if we have found at least on point that belongs to a triangle
-		 * in current row and current point doesn't belong to the triangle then
-		 * there is no reason to continue scanning this row.
-		 */
-		/* TODO: it's possible to remember left border on the previous row and
-		 * start scanning to the left from this position. it's possible there
-		 * are few or none pixels which belong to the triangle
-		 */
-		for (int x = bbox_min.x; x <= bbox_max.x; x++) {
-			vec3f_t p{ x + 0.5f, y + 0.5f, 0.f };
-
-			/* to barycentric coordinates */
-			auto edge = p2 - p1;
-			/* w0: signed area of the triangle v1v2p multiplied by 2 */
-			auto w0 = edge_function(p1, p2, p);
-			/* check if edge function is positive, if the point is on the edge,
-			 * check if it is a top or left edge
-			 */
-			if (w0 < 0 || (w0 == 0 && ((edge.y == 0 && edge.x <= 0) || edge.y < 0)))
-			//if (w0 < 0)
-				continue;
-
-			edge = p0 - p2;
-			/* w1: signed area of the triangle v2v0p multiplied by 2 */
-			auto w1 = edge_function(p2, p0, p);
-			/* check if edge function is positive, if the point is on the edge,
-			 * check if it is a top or left edge
-			 */
-			if (w1 < 0 || (w1 == 0 && ((edge.y == 0 && edge.x <= 0) || edge.y < 0)))
-			//if (w1 < 0)
-				continue;
-
-			edge = p1 - p0;
-			/* w2: signed area of the triangle v0v1p multiplied by 2 */
-			auto w2 = edge_function(p0, p1, p);
-			/* check if edge function is positive, if the point is on the edge,
-			 * check if it is a top or left edge
-			 */
-			if (w2 < 0 || (w2 == 0 && ((edge.y == 0 && edge.x <= 0) || edge.y < 0)))
-			//if (w2 < 0)
-				continue;
-
-			/* If we are here the point{x, y} is inside the triangle{p0, p1, p2}
-			 * Calculate area of the triangle multiplied by 2 and normalize
-			 * coefficients
-			 */
-			auto area = edge_function(p0, p1, p2);
-			w0 /= area;
-			w1 /= area;
-			w2 /= area;
-
-			/* depth test */
-			p.z = w0 * p0.z + w1 * p1.z + w2 * p2.z;
-			if (!zbuf::put(x, y, p.z))
-				continue;
-
-			/* calculate normal */
-			vec3f_t n = project_to_world({ w0 * v0.norm + w1 * v1.norm + w2 * v2.norm });
-			n.normalize();
-
-			/* calculate light intensity */
-			float intensity = n.z; /* TODO: multiply by light vector */
-			/* back-face culling */
-			if (intensity < 0.f)
-				continue;
-
-			/* calculate color */
-			uint32_t color;
-			if (texture.color != nullptr) {
-				/* calculate texture coordinate */
-				vec2f_t tex = w0 * v0.tex + w1 * v1.tex + w2 * v2.tex;
-
-				uint32_t t = texture(tex.u, tex.v);
-				float r = intensity * get_r(t);
-				float g = intensity * get_g(t);
-				float b = intensity * get_b(t);
-
-				color = make_color(r, g, b);
-			} else {
-				/* calculate color from vertex color */
-				//float r = w0 * get_r(v0.color) + w1 * get_r(v1.color) + w2 * get_r(v2.color);
-				//float g = w0 * get_g(v0.color) + w1 * get_g(v1.color) + w2 * get_g(v2.color);
-				//float b = w0 * get_b(v0.color) + w1 * get_b(v1.color) + w2 * get_b(v2.color);
-				//display::put(x, y, make_color(r, g, b));
-
-				color = make_color(intensity);
-			}
-			display::put(x, y, color);
-		}
-	}
+	PROFILE_ZONE("render::triangle");
+	with_standard_shader([&](const auto& s) {
+		triangle(s, v0, v1, v2);
+	});
 }
 
 void render::triangle(const std::vector<::model_t::Face>& faces,
@@ -193,23 +122,84 @@ void render::triangle(const std::vector<::model_t::Face>& faces,
 	const std::vector<std::vector<float>>& normals,
 	const std::vector<std::vector<float>>& texture_uv)
 {
-	for (auto& face : faces) {
-		Vertex v[3];
+	PROFILE_ZONE("render::triangle");
+	with_standard_shader([&](const auto& s) {
+		triangle(s, faces, vertices, normals, texture_uv);
+	});
+}
+
+/* Set a texture of the cache as the texture of the current material. With
+ * mipmapping the coarser levels are its mip levels, up to the 1x1 one or the
+ * first one which isn't available: being loaded by another thread.
+ */
+static void bind_texture(textures::id_t id, unsigned lod)
+{
+	textures::image_t img = textures::get(id, lod);
 
-		for (size_t i = 0; i < 3; i++)
-			v[i].v = { vertices[(size_t)face.v_idx[i] - 1][0],
-				vertices[(size_t)face.v_idx[i] - 1][1],
-				vertices[(size_t)face.v_idx[i] - 1][2] };
+	material.texture = {};
+	material.mips.count = 0;
+	if (!img.pixels)
+		return;
 
-		for (size_t i = 0; i < 3; i++)
-			v[i].norm = { normals[(size_t)face.n_idx[i] - 1][0],
-				normals[(size_t)face.n_idx[i] - 1][1],
-				normals[(size_t)face.n_idx[i] - 1][2] };
+	material.texture = { img.pixels, img.width, img.height };
+	if (!render::is_mipmapping_enabled())
+		return;
 
-		for (size_t i = 0; i < 3; i++)
-			v[i].tex = { texture_uv[(size_t)face.tex_idx[i] - 1][0],
-				texture_uv[(size_t)face.tex_idx[i] - 1][1] };
+	material.mips.level[material.mips.count++] = material.texture;
+	while (material.mips.count < render::mip_chain_t::MAX_LEVELS && (img.width > 1 || img.height > 1)) {
+		textures::image_t next = textures::get(id, img.level + 1);
+		if (!next.pixels || next.level != img.level + 1)
+			break;
 
-		triangle(v[0], v[1], v[2]);
+		img = next;
+		material.mips.level[material.mips.count++] = { img.pixels, img.width, img.height };
+	}
+}
+
+void render::triangle(const ::model_t& model)
+{
+	PROFILE_ZONE("render::triangle");
+	const material_t current = material;
+
+	/* faces without a material use the model texture */
+	auto bind_default = [&model, &current]() {
+		material = current;
+		if (model.texture_id_ != textures::NONE)
+			bind_texture(model.texture_id_, model.texture_lod_);
+	};
+
+	/* a streamed model is grouped once it's complete */
+	if (model.ranges_.empty()) {
+		bind_default();
+		with_standard_shader([&](const auto& s) {
+			triangle(s, model.faces_, model.vertices_, model.normals_, model.texture_);
+		});
+		material = current;
+		return;
 	}
+
+	for (const auto& r : model.ranges_) {
+		if (r.material < 0) {
+			bind_default();
+		} else {
+			const auto& m = model.materials_[(size_t)r.material];
+			bind_texture(m.texture, model.texture_lod_);
+			material.diffuse = { m.diffuse[0], m.diffuse[1], m.diffuse[2] };
+		}
+
+		with_standard_shader([&](const auto& s) {
+			triangle(s, model.faces_, model.vertices_, model.normals_, model.texture_, r.first, r.count);
+		});
+	}
+	material = current;
+}
+
+void render::shadow_triangle(const std::vector<::model_t::Face>& faces,
+	const std::vector<std::vector<float>>& vertices)
+{
+	if (!is_shadow_enabled())
+		return;
+
+	PROFILE_ZONE("render::shadow_triangle");
+	triangle(depth_shader{ shadow::get_surface(), get_light_mvp() }, faces, vertices);
 }
@@ -4,10 +4,33 @@
 #include <cstdint>
 #include <vector>
 #include <model/model.h>
+#include <render/texture.h>
 #include <vector.h>
 
 namespace render {
 
+/** Face culling mode */
+enum class cull_mode {
+	none,  /**< Draw both front and back faces */
+	back,  /**< Discard back faces */
+	front, /**< Discard front faces */
+};
+
+/** Where diffuse light is calculated */
+enum class lighting_mode {
+	per_pixel,  /**< Normals are interpolated, light is calculated per pixel */
+	per_vertex, /**< Light is calculated per vertex and interpolated (Gouraud
+		      shading): faster, but highlights and shadow edges are coarse */
+};
+
+/** Surface properties of triangles drawn by the built-in shader */
+struct material_t {
+	texture_t texture;                 /**< Diffuse texture, none if color is nullptr */
+	mip_chain_t mips;                  /**< Mip levels of the texture from texture,
+					     none if count is 0 */
+	vec3f_t diffuse{ 1.f, 1.f, 1.f }; /**< Diffuse color (0.0 - 1.0), modulates the texture */
+};
+
 /** A triangle vertex descriptor */
 struct Vertex {
 	vec3f_t v;      /**< Geometric vertex */
@@ -19,7 +42,12 @@ struct Vertex {
 /** Render a triangle in model coordinates
  * Vertices passed counter clockwise. Texture has to be set by set_texture()
  * call. If texture is not set light intensity is used to color the triangle.
- * 
+ *
+ * The rasterizer is specialized for every combination of pipeline state
+ * (depth test, depth write, texture, lighting and culling). The matching
+ * specialization is selected once per call, so there is no state checks per
+ * pixel. See render/shader.h for overloads taking a custom shader.
+ *
  * @param v0: A triangle vertex
  * @param v1: A triangle vertex
  * @param v2: A triangle vertex
@@ -40,18 +68,60 @@ void triangle(const std::vector<::model_t::Face>& faces,
 	const std::vector<std::vector<float>>& normals,
 	const std::vector<std::vector<float>>& texture_uv);
 
-/** Set current texture
+/** Render a model batched by material
+ * Faces of a material are drawn by one call with the material set, so a
+ * texture is bound once per frame however faces of materials are
+ * interleaved in the file. Faces without a material and models not grouped
+ * by material (see model_t::group_by_material()) are drawn with the model
+ * texture, or the current material if the model has none. Textures are
+ * taken from the texture cache at the model mip level, see textures::get(),
+ * and so are the coarser levels if mipmapping is enabled. The current
+ * material is restored after the call.
+ *
+ * @param model: the model.
+ *
+ * @note The function doesn't check if model arrays are valid.
+ */
+void triangle(const ::model_t& model);
+
+/** Render shadow casters to the shadow map
+ * A depth-only pass from the light: only vertex positions are processed.
+ * Draw casters before lit triangles of the frame. Does nothing if shadows are
+ * disabled (see shadow_enable()).
+ *
+ * @param faces: an array of faces.
+ * @param vertices: an array of vertex coordinates.
+ *
+ * @note The function doesn't check if input arrays are valid.
+ */
+void shadow_triangle(const std::vector<::model_t::Face>& faces,
+	const std::vector<std::vector<float>>& vertices);
+
+/** Set texture of the current material
  *
  * @param image: texture data in RGB888 format.
  * @param width: texture width.
  * @param height: texture height.
  *
  * @note Texture data must be available while texture is used. The function
- * doesn't perform a copy of the texture, but stores a pointer to it.
+ * doesn't perform a copy of the texture, but stores a pointer to it. The
+ * texture has no mip levels.
  * @todo it's temporary
  */
 void set_texture(const std::vector<uint32_t>& image, size_t width, size_t height);
 
+/** Set current material
+ *
+ * @param material: the material.
+ *
+ * @note Texture data must be available while the material is used, see
+ * set_texture().
+ */
+void set_material(const material_t& material);
+
+/** Get current material */
+const material_t& get_material(void);
+
 } /* namespace render */
 
 #endif /* RENDER_TRIANGLE_H_ */
@@ -1,30 +1,64 @@
 #include "zbuf.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
 #include <vector>
+#include <jobs/jobs.h>
 
 static unsigned width;
 static unsigned height;
+static render::zbuf::format depth_format = render::zbuf::format::float32;
 
-static std::vector<float> zbuffer;
+static std::vector<uint8_t> zbuffer;
 
-int render::zbuf::init(int w, int h)
+/* Points cleared by a job */
+constexpr size_t CLEAR_GRAIN = 1 << 16;
+
+int render::zbuf::init(int w, int h, format fmt)
 {
 	if (w <= 0 || h <= 0)
 		return 1;
 
-	zbuffer.resize(w * h);
+	zbuffer.resize(display::tile_size(w, h) * get_bytes(fmt));
 	width = w;
 	height = h;
+	depth_format = fmt;
 	return 0;
 }
 
+render::zbuf::format render::zbuf::get_format(void)
+{
+	return depth_format;
+}
+
 void render::zbuf::release(void)
 {
 	zbuffer.resize(0);
 }
 
+render::zbuf::surface_t render::zbuf::get_surface(void)
+{
+	return { zbuffer.data(), (int)width, (int)height, depth_format };
+}
+
 void render::zbuf::clear(void)
 {
-	std::fill(zbuffer.begin(), zbuffer.end(), std::numeric_limits<float>::lowest());
+	/* with the padding of the tiles */
+	size_t points = display::tile_size(width, height);
+
+	if (depth_format == format::float32) {
+		float *depth = reinterpret_cast<float *>(zbuffer.data());
+		jobs::parallel_for(points, CLEAR_GRAIN, [depth](size_t begin, size_t end) {
+			std::fill(depth + begin, depth + end, std::numeric_limits<float>::lowest());
+		});
+		return;
+	}
+
+	size_t bytes = get_bytes(depth_format);
+	jobs::parallel_for(points, CLEAR_GRAIN, [bytes](size_t begin, size_t end) {
+		std::memset(zbuffer.data() + begin * bytes, 0, (end - begin) * bytes);
+	});
 }
 
 bool render::zbuf::depth_test(int x, int y, float z)
@@ -32,15 +66,13 @@ bool render::zbuf::depth_test(int x, int y, float z)
 	if (x < 0 || (unsigned)x >= width || y < 0 || (unsigned)y >= height)
 		return false;
 
-	return z > zbuffer[(size_t)y * width + x];
+	return get_surface().depth_test(x, y, z);
 }
 
 bool render::zbuf::put(int x, int y, float z)
 {
-	if (depth_test(x, y, z)) {
-		zbuffer[(size_t)y * width + x] = z;
-		return true;
-	}
+	if (x < 0 || (unsigned)x >= width || y < 0 || (unsigned)y >= height)
+		return false;
 
-	return false;
+	return get_surface().put(x, y, z);
 }
@@ -1,19 +1,241 @@
 #ifndef RENDER_ZBUF_H_
 #define RENDER_ZBUF_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <display/display.h>
+
 namespace render::zbuf {
 
+/** Depth buffer formats
+ * Every format keeps a greater value for a closer point.
+ */
+enum class format {
+	float32,          /**< Screen z as is, 4 bytes per point. Default */
+	unorm16,          /**< Depth normalized within the depth range (see
+			       render::set_depth_range()), 2 bytes per point */
+	unorm24,          /**< The same as unorm16, 3 bytes per point */
+	reversed_float32, /**< near / distance, 4 bytes per point. Float
+			       precision grows with the distance (reversed-Z) */
+};
+
+/** Depth storage of a format
+ * key() converts a depth to the value stored for it, keys compare the same
+ * way as depths. load() and store() access point i of a row, i is the offset
+ * of the point's column (display::tile_column()).
+ */
+template <format F>
+struct traits {
+	static constexpr format FORMAT = F;
+	static constexpr size_t BYTES = 4;
+	using key_t = float;
+
+	static key_t key(float z) { return z; }
+	static key_t load(const void *row, size_t i) { return static_cast<const float *>(row)[i]; }
+	static void store(void *row, size_t i, key_t k) { static_cast<float *>(row)[i] = k; }
+};
+
+template <>
+struct traits<format::reversed_float32> : traits<format::float32> {
+	static constexpr format FORMAT = format::reversed_float32;
+};
+
+/* Depth clamped to [0, 1] and scaled to BITS. NaN is the farthest */
+template <int BITS>
+inline uint32_t unorm(float z)
+{
+	constexpr uint32_t MAX = (1u << BITS) - 1;
+
+	z = z > 0.f ? z : 0.f;
+	z = z < 1.f ? z : 1.f;
+	/* with 24 bits, z * MAX + 0.5 rounds up to 1 << 24 close to 1 */
+	uint32_t k = (uint32_t)(z * (float)MAX + 0.5f);
+	return k < MAX ? k : MAX;
+}
+
+template <>
+struct traits<format::unorm16> {
+	static constexpr format FORMAT = format::unorm16;
+	static constexpr size_t BYTES = 2;
+	using key_t = uint32_t;
+
+	static key_t key(float z) { return unorm<16>(z); }
+	static key_t load(const void *row, size_t i) { return static_cast<const uint16_t *>(row)[i]; }
+	static void store(void *row, size_t i, key_t k) { static_cast<uint16_t *>(row)[i] = (uint16_t)k; }
+};
+
+/* Packed little endian. Points are written byte by byte: a word write would
+ * touch a neighbour, which may belong to another tile and job.
+ */
+template <>
+struct traits<format::unorm24> {
+	static constexpr format FORMAT = format::unorm24;
+	static constexpr size_t BYTES = 3;
+	using key_t = uint32_t;
+
+	static key_t key(float z) { return unorm<24>(z); }
+
+	static key_t load(const void *row, size_t i)
+	{
+		const uint8_t *p = static_cast<const uint8_t *>(row) + i * 3;
+		return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+	}
+
+	static void store(void *row, size_t i, key_t k)
+	{
+		uint8_t *p = static_cast<uint8_t *>(row) + i * 3;
+		p[0] = (uint8_t)k;
+		p[1] = (uint8_t)(k >> 8);
+		p[2] = (uint8_t)(k >> 16);
+	}
+};
+
+/** Call fn(traits<F>{}) for a format known at run time */
+template <typename FN>
+decltype(auto) dispatch(format fmt, FN&& fn)
+{
+	switch (fmt) {
+	case format::unorm16:
+		return fn(traits<format::unorm16>{});
+	case format::unorm24:
+		return fn(traits<format::unorm24>{});
+	case format::reversed_float32:
+		return fn(traits<format::reversed_float32>{});
+	default:
+		return fn(traits<format::float32>{});
+	}
+}
+
+/** Get bytes per point of a format */
+inline size_t get_bytes(format fmt)
+{
+	return dispatch(fmt, [](auto t) { return decltype(t)::BYTES; });
+}
+
+/** Direct depth buffer access
+ * The fast path for rasterizers: no bounds checks and no function calls per
+ * pixel. Callers clip coordinates to the buffer size themselves. The
+ * rasterizer accesses rows through traits of the format it's specialized
+ * for, the other functions dispatch on the format per call. Points are tiled
+ * like pixels of the frame buffer (see display::TILE).
+ */
+struct surface_t {
+	void *depth;
+	int width;
+	int height;
+	format fmt = format::float32;
+
+	/** Get a pointer to a row of format F. Point x of the row is
+	 * traits<F>::load(row, display::tile_column(x)). y must be within the
+	 * surface
+	 */
+	template <format F>
+	void *row(int y) const
+	{
+		return static_cast<char *>(depth) + display::tile_row(y, width) * traits<F>::BYTES;
+	}
+
+	/** Do depth test. x, y must be within the surface */
+	bool depth_test(int x, int y, float z) const
+	{
+		return dispatch(fmt, [&](auto t) {
+			using T = decltype(t);
+			return T::key(z) > T::load(row<T::FORMAT>(y), display::tile_column(x));
+		});
+	}
+
+	/** Do depth test and store z if passed. x, y must be within the surface */
+	bool put(int x, int y, float z) const
+	{
+		return dispatch(fmt, [&](auto t) {
+			using T = decltype(t);
+			void *r = row<T::FORMAT>(y);
+			size_t i = display::tile_column(x);
+			auto k = T::key(z);
+			if (k > T::load(r, i)) {
+				T::store(r, i, k);
+				return true;
+			}
+			return false;
+		});
+	}
+
+	/** Do depth test of n points of a row starting from x
+	 * The span must be within the surface.
+	 *
+	 * @param z: depth of the points.
+	 * @param mask: on input points to test (non-zero), on output points which
+	 * passed the test.
+	 * @return number of points passed.
+	 */
+	int test_span(int x, int y, int n, const float *z, bool *mask) const
+	{
+		return dispatch(fmt, [&](auto t) {
+			using T = decltype(t);
+			const void *r = row<T::FORMAT>(y);
+			int passed = 0;
+			for (int i = 0; i < n; i++) {
+				mask[i] = mask[i] && T::key(z[i]) > T::load(r, display::tile_column(x + i));
+				passed += mask[i];
+			}
+			return passed;
+		});
+	}
+
+	/** Store depth of n points of a row starting from x
+	 * Only points with non-zero mask are written. The span must be within the
+	 * surface.
+	 */
+	void write_span(int x, int y, int n, const float *z, const bool *mask) const
+	{
+		dispatch(fmt, [&](auto t) {
+			using T = decltype(t);
+			void *r = row<T::FORMAT>(y);
+			for (int i = 0; i < n; i++) {
+				if (mask[i])
+					T::store(r, display::tile_column(x + i), T::key(z[i]));
+			}
+		});
+	}
+
+	/** Fill a rectangle. The rectangle must be within the surface */
+	void fill(int x, int y, int w, int h, float z) const
+	{
+		dispatch(fmt, [&](auto t) {
+			using T = decltype(t);
+			auto k = T::key(z);
+			for (int r = y; r < y + h; r++) {
+				void *p = row<T::FORMAT>(r);
+				for (int i = x; i < x + w; i++)
+					T::store(p, display::tile_column(i), k);
+			}
+		});
+	}
+};
+
 /** Initialize depth buffer
  *
  * @param w: buffer width (in screen coordinates).
  * @param h: buffer height (in screen coordinates).
+ * @param fmt: depth format.
  * @return 0 on success.
  */
-int init(int w, int h);
+int init(int w, int h, format fmt = format::float32);
+
+/** Get format of the depth buffer */
+format get_format(void);
 
-/** Clear depth buffer */
+/** Clear depth buffer
+ * float32 is cleared to the lowest float, the other formats to zero: the
+ * far plane for unorm formats, infinitely far for reversed_float32.
+ */
 void clear(void);
 
+/** Get depth buffer surface
+ * The surface is valid until release() or next init() call.
+ */
+surface_t get_surface(void);
+
 /** Release depth buffer resources.
  *
  * @note It's safe to invoke the function if init() failed or has never been
@@ -0,0 +1,30 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+/* Instruction set selection for the hand vectorized paths.
+ *
+ * SIMD_SSE:    x86 with SSE2 (always true for x86-64).
+ * SIMD_AVX:    x86 with AVX, implies SIMD_SSE.
+ * SIMD_NEON:   AArch64 Advanced SIMD.
+ * SIMD_SCALAR: none of the above, portable C++ only.
+ *
+ * Define SIMD_FORCE_SCALAR to build the portable fallback on any target (e.g.
+ * to compare results of vectorized code against the reference one).
+ */
+#if defined(SIMD_FORCE_SCALAR)
+#define SIMD_SCALAR 1
+#elif defined(__AVX__)
+#define SIMD_AVX 1
+#define SIMD_SSE 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define SIMD_SCALAR 1
+#endif
+
+#endif /* SIMD_H_ */
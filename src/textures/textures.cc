@@ -0,0 +1,263 @@
+#include "textures.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <model/model.h>
+#include <profile/profile.h>
+
+static constexpr size_t DEFAULT_BUDGET = 256 << 20;
+
+struct level_t {
+	std::vector<uint32_t> pixels; /* empty if not in memory */
+	uint64_t last_used = 0;       /* frame number */
+	unsigned readers = 0;         /* threads filtering it down */
+};
+
+struct texture_t {
+	std::string filename;
+	/* size of level 0, known once the file is decoded */
+	size_t width = 0;
+	size_t height = 0;
+	std::vector<level_t> levels;
+	/* decoded by a thread without the lock */
+	bool loading = false;
+	bool failed = false;
+};
+
+static std::mutex lock;
+/* guarded by lock */
+static std::vector<std::unique_ptr<texture_t>> entries;
+static std::unordered_map<std::string, textures::id_t> ids;
+static uint64_t frame_number = 2;
+static size_t budget = DEFAULT_BUDGET;
+static textures::stats_t stats;
+
+static size_t level_size(size_t size, unsigned level)
+{
+	return std::max(size >> level, (size_t)1);
+}
+
+static textures::image_t view(texture_t& t, unsigned level)
+{
+	t.levels[level].last_used = frame_number;
+	return { t.levels[level].pixels.data(), level_size(t.width, level), level_size(t.height, level), level };
+}
+
+/* The level in memory closest to a level, pixels are nullptr if none */
+static textures::image_t closest(texture_t& t, unsigned level)
+{
+	int best = -1;
+
+	for (unsigned i = 0; i < t.levels.size(); i++) {
+		if (t.levels[i].pixels.empty())
+			continue;
+		if (best < 0 || std::abs((int)i - (int)level) < std::abs(best - (int)level))
+			best = (int)i;
+	}
+
+	return best < 0 ? textures::image_t{} : view(t, (unsigned)best);
+}
+
+/* Box filter an image down to a level size */
+static std::vector<uint32_t> downscale(const uint32_t *src, size_t src_w, size_t src_h, size_t w, size_t h)
+{
+	std::vector<uint32_t> dst(w * h);
+
+	for (size_t y = 0; y < h; y++) {
+		for (size_t x = 0; x < w; x++) {
+			/* texels of the box */
+			const size_t x0 = x * src_w / w, x1 = (x + 1) * src_w / w;
+			const size_t y0 = y * src_h / h, y1 = (y + 1) * src_h / h;
+			uint32_t sum[3] = {};
+
+			for (size_t v = y0; v < y1; v++) {
+				for (size_t u = x0; u < x1; u++) {
+					uint32_t c = src[v * src_w + u];
+					for (size_t i = 0; i < 3; i++)
+						sum[i] += (c >> (8 * i)) & 0xFF;
+				}
+			}
+
+			const uint32_t n = (uint32_t)((x1 - x0) * (y1 - y0));
+			uint32_t c = 0;
+			for (size_t i = 0; i < 3; i++)
+				c |= (sum[i] / n) << (8 * i);
+			dst[y * w + x] = c;
+		}
+	}
+
+	return dst;
+}
+
+/* Evict least recently used levels till the budget is met. Levels of the
+ * current and the previous frames stay.
+ */
+static void evict(void)
+{
+	while (stats.resident > budget) {
+		level_t *lru = nullptr;
+
+		for (auto& t : entries) {
+			for (auto& l : t->levels) {
+				if (!l.pixels.empty() && !l.readers && l.last_used + 1 < frame_number &&
+					(!lru || l.last_used < lru->last_used))
+					lru = &l;
+			}
+		}
+		if (!lru)
+			return;
+
+		stats.resident -= lru->pixels.size() * sizeof(uint32_t);
+		stats.evictions++;
+		std::vector<uint32_t>().swap(lru->pixels);
+	}
+}
+
+textures::id_t textures::open(const char *filename)
+{
+	std::lock_guard<std::mutex> g(lock);
+
+	auto it = ids.find(filename);
+	if (it != ids.end())
+		return it->second;
+
+	if (!std::ifstream(filename, std::ifstream::binary).is_open()) {
+		std::cerr << "Failed to open " << std::quoted(filename) << "\n";
+		return NONE;
+	}
+
+	id_t id = (id_t)entries.size();
+	entries.push_back(std::make_unique<texture_t>());
+	entries.back()->filename = filename;
+	ids.emplace(filename, id);
+	return id;
+}
+
+textures::image_t textures::get(id_t id, unsigned level)
+{
+	std::unique_lock<std::mutex> g(lock);
+
+	if (id >= entries.size())
+		return {};
+	texture_t& t = *entries[id];
+
+	if (!t.levels.empty()) {
+		level = std::min(level, (unsigned)t.levels.size() - 1);
+		if (!t.levels[level].pixels.empty()) {
+			stats.hits++;
+			return view(t, level);
+		}
+	}
+
+	stats.misses++;
+	if (t.loading || t.failed)
+		return closest(t, level);
+
+	/* filter the closest finer level down, or decode the file */
+	int src = -1;
+	for (int i = (int)std::min<size_t>(level, t.levels.size()) - 1; i >= 0 && src < 0; i--) {
+		if (!t.levels[(size_t)i].pixels.empty())
+			src = i;
+	}
+
+	/* a level in memory is read without the lock, don't evict it */
+	const bool filtered = src >= 0;
+	std::vector<uint32_t> decoded;
+	const uint32_t *src_pixels = nullptr;
+	size_t src_w = 0, src_h = 0;
+	if (filtered) {
+		textures::image_t img = view(t, (unsigned)src);
+		t.levels[(size_t)src].readers++;
+		src_pixels = img.pixels;
+		src_w = img.width;
+		src_h = img.height;
+	}
+	t.loading = true;
+	g.unlock();
+
+	if (!filtered) {
+		PROFILE_ZONE("decode texture");
+		size_t w, h;
+		if (model_t::load_tga(t.filename.c_str(), decoded, w, h) != std::errc() || !w || !h) {
+			std::cerr << "Failed to load texture " << std::quoted(t.filename) << "\n";
+			g.lock();
+			t.loading = false;
+			t.failed = true;
+			return closest(t, level);
+		}
+		src = 0;
+		src_pixels = decoded.data();
+		src_w = w;
+		src_h = h;
+
+		/* sized when the file is decoded for the first time */
+		if (t.levels.empty()) {
+			unsigned count = 1;
+			while (level_size(w, count - 1) > 1 || level_size(h, count - 1) > 1)
+				count++;
+			level = std::min(level, count - 1);
+
+			g.lock();
+			t.width = w;
+			t.height = h;
+			t.levels.resize(count);
+			g.unlock();
+		}
+	}
+
+	std::vector<uint32_t> pixels;
+	if ((unsigned)src == level) {
+		pixels = std::move(decoded);
+	} else {
+		PROFILE_ZONE("filter texture");
+		pixels = downscale(src_pixels, src_w, src_h, level_size(t.width, level), level_size(t.height, level));
+	}
+
+	g.lock();
+	t.loading = false;
+	if (filtered)
+		t.levels[(size_t)src].readers--;
+	stats.resident += pixels.size() * sizeof(uint32_t);
+	t.levels[level].pixels = std::move(pixels);
+	textures::image_t img = view(t, level);
+	evict();
+
+	return img;
+}
+
+void textures::frame(void)
+{
+	std::lock_guard<std::mutex> g(lock);
+	frame_number++;
+	/* levels used two frames ago may be evicted now */
+	evict();
+}
+
+void textures::set_budget(size_t bytes)
+{
+	std::lock_guard<std::mutex> g(lock);
+	budget = bytes;
+	evict();
+}
+
+textures::stats_t textures::get_stats(void)
+{
+	std::lock_guard<std::mutex> g(lock);
+	stats.budget = budget;
+	return stats;
+}
+
+void textures::reset_stats(void)
+{
+	std::lock_guard<std::mutex> g(lock);
+	stats.hits = 0;
+	stats.misses = 0;
+	stats.evictions = 0;
+}
@@ -0,0 +1,85 @@
+#ifndef TEXTURES_TEXTURES_H_
+#define TEXTURES_TEXTURES_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/* Texture residency cache
+ *
+ * Decoded textures and their mip levels are owned by the cache and kept
+ * under a memory budget. A texture is opened once per file, however many
+ * models use it, and decoded when a level of it is first requested. A mip
+ * level is filtered down from the closest finer level in memory, or from the
+ * decoded file. When the budget is exceeded the least recently used levels
+ * are evicted, and they're loaded again on the next request.
+ *
+ * Levels used by the current or the previous frame are never evicted, a
+ * pipelined frame may still sample them. Frames are counted by frame(),
+ * called by render::clear().
+ *
+ * The cache is thread safe. A texture is decoded by the thread requesting it
+ * first, other threads get the closest level in memory meanwhile, so a
+ * texture can be prefetched by a loader thread.
+ */
+namespace textures {
+
+using id_t = uint32_t;
+
+/** Not a texture */
+constexpr id_t NONE = UINT32_MAX;
+
+/** A mip level of a texture */
+struct image_t {
+	const uint32_t *pixels; /**< colors in RGB888 format, nullptr if none */
+	size_t width;
+	size_t height;
+	unsigned level;         /**< 0 - the full resolution */
+};
+
+/** Cache statistics */
+struct stats_t {
+	uint64_t hits;      /**< requests of levels in memory */
+	uint64_t misses;    /**< requests of levels which were loaded or filtered */
+	uint64_t evictions; /**< levels dropped to stay under the budget */
+	size_t resident;    /**< bytes of levels in memory */
+	size_t budget;      /**< bytes */
+};
+
+/** Open a texture
+ * The file is decoded on demand by get(). Only TGA images are supported,
+ * see model_t::load_tga().
+ *
+ * @param filename: the file.
+ * @return the texture, the same for the same file name. NONE if the file
+ * can't be opened.
+ */
+id_t open(const char *filename);
+
+/** Get a mip level of a texture
+ * The level is loaded if it's not in memory. If another thread is loading
+ * the texture or it fails to load, the closest level in memory is returned.
+ *
+ * @param id: the texture.
+ * @param level: the level, clamped to the coarsest one (1x1).
+ * @return the level, pixels are nullptr if none is available. Pixels are
+ * valid till the end of the next frame.
+ */
+image_t get(id_t id, unsigned level = 0);
+
+/** Mark the start of a frame */
+void frame(void);
+
+/** Set the memory budget
+ * Levels are evicted right away if it's exceeded.
+ *
+ * @param bytes: memory of decoded levels.
+ */
+void set_budget(size_t bytes);
+
+/** Get statistics collected since the last reset */
+stats_t get_stats(void);
+void reset_stats(void);
+
+} /* namespace textures */
+
+#endif /* TEXTURES_TEXTURES_H_ */
@@ -1,6 +1,7 @@
 #ifndef VEC_H_
 #define VEC_H_
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
@@ -8,12 +9,84 @@
 #include <ostream>
 #include <type_traits>
 #include "matrix.h"
+#include "simd.h"
 
+/* Vector components storage.
+ * Named components alias the array through an anonymous union, so v.x and v[0]
+ * is the same element. Anonymous structs are a language extension, but the one
+ * GCC, Clang and MSVC agree on.
+ */
 template <size_t SIZE, typename T>
-struct vec_t {
+struct vec_storage {
+	vec_storage(void) : data{ 0 }
+	{
+	}
+
+	vec_storage(const std::array<T, SIZE>& a) : data(a)
+	{
+	}
+
+	std::array<T, SIZE> data;
+};
+
+template <typename T>
+struct vec_storage<2, T> {
+	vec_storage(void) : data{ 0 }
+	{
+	}
+
+	vec_storage(const std::array<T, 2>& a) : data(a)
+	{
+	}
+
+	union {
+		std::array<T, 2> data;
+		struct { T x, y; };
+		struct { T u, v; };
+	};
+};
+
+template <typename T>
+struct vec_storage<3, T> {
+	vec_storage(void) : data{ 0 }
+	{
+	}
+
+	vec_storage(const std::array<T, 3>& a) : data(a)
+	{
+	}
+
+	union {
+		std::array<T, 3> data;
+		struct { T x, y, z; };
+		struct { T u, v; };
+	};
+};
+
+template <typename T>
+struct vec_storage<4, T> {
+	vec_storage(void) : data{ 0 }
+	{
+	}
+
+	vec_storage(const std::array<T, 4>& a) : data(a)
+	{
+	}
+
+	union {
+		std::array<T, 4> data;
+		struct { T x, y, z, w; };
+		struct { T u, v; };
+	};
+};
+
+template <size_t SIZE, typename T>
+struct vec_t : vec_storage<SIZE, T> {
 	static_assert(SIZE > 0);
 
-	vec_t(void) : data{ 0 }
+	using vec_storage<SIZE, T>::data;
+
+	vec_t(void)
 	{
 	}
 
@@ -46,34 +119,10 @@ struct vec_t {
 
 	template <typename... RestArgs>
 	vec_t(typename std::enable_if<sizeof...(RestArgs) + 1 == SIZE, T>::type first, RestArgs... rest)
-		: data{ first, T(rest)... }
+		: vec_storage<SIZE, T>(std::array<T, SIZE>{ first, T(rest)... })
 	{
 	}
 
-	T getx(void) const { return data[0]; }
-	void putx(T val) { data[0] = val; }
-	__declspec(property(get = getx, put = putx)) T x;
-	__declspec(property(get = getx, put = putx)) T u;
-
-	template <size_t SZ = SIZE, typename std::enable_if_t<SZ >= 2, int> = 0>
-	T gety(void) const { return data[1]; }
-	template <size_t SZ = SIZE, typename std::enable_if_t<SZ >= 2, int> = 0>
-	void puty(T val) { data[1] = val; }
-	__declspec(property(get = gety, put = puty)) T y;
-	__declspec(property(get = gety, put = puty)) T v;
-
-	template <size_t SZ = SIZE, typename std::enable_if_t<SZ >= 3, int> = 0>
-	T getz(void) const { return data[2]; }
-	template <size_t SZ = SIZE, typename std::enable_if_t<SZ >= 3, int> = 0>
-	void putz(T val) { data[2] = val; }
-	__declspec(property(get = getz, put = putz)) T z;
-
-	template <size_t SZ = SIZE, typename std::enable_if_t<SZ >= 4, int> = 0>
-	T getw(void) const { return data[3]; }
-	template <size_t SZ = SIZE, typename std::enable_if_t<SZ >= 4, int> = 0>
-	void putw(T val) { data[3] = val; }
-	__declspec(property(get = getw, put = putw)) T w;
-
 	/* Return a vector length (magnitude) */
 	T length(void) const
 	{
@@ -146,10 +195,10 @@ struct vec_t {
 	template <size_t SZ = SIZE, typename std::enable_if_t<SZ == 3, int> = 0>
 	vec_t<SIZE, T>& operator^=(const vec_t<SIZE, T>& rhs)
 	{
-		T x = this->y * rhs.z - this->z * rhs.y;
-		T y = this->z * rhs.x - this->x * rhs.z;
-		T z = this->x * rhs.y - this->y * rhs.x;
-		this->data = { x, y, z };
+		T cx = this->y * rhs.z - this->z * rhs.y;
+		T cy = this->z * rhs.x - this->x * rhs.z;
+		T cz = this->x * rhs.y - this->y * rhs.x;
+		data = { cx, cy, cz };
 		return *this;
 	}
 
@@ -198,9 +247,6 @@ struct vec_t {
 		copy /= scalar;
 		return copy;
 	}
-
-protected:
-	std::array<T, SIZE> data;
 };
 
 template <size_t SIZE, typename T>
@@ -226,4 +272,121 @@ using vec3f_t = vec_t<3, float>;
 using vec3i_t = vec_t<3, int>;
 using vec4f_t = vec_t<4, float>;
 
+static_assert(sizeof(vec4f_t) == 4 * sizeof(float), "vec4f_t must be packed");
+
+/* Vectorized 4-wide single precision operations. The scalar build uses the
+ * generic implementation.
+ */
+#if defined(SIMD_SSE)
+template <>
+inline vec4f_t& vec4f_t::operator+=(const vec4f_t& rhs)
+{
+	_mm_storeu_ps(data.data(), _mm_add_ps(_mm_loadu_ps(data.data()), _mm_loadu_ps(rhs.data.data())));
+	return *this;
+}
+
+template <>
+inline vec4f_t& vec4f_t::operator-=(const vec4f_t& rhs)
+{
+	_mm_storeu_ps(data.data(), _mm_sub_ps(_mm_loadu_ps(data.data()), _mm_loadu_ps(rhs.data.data())));
+	return *this;
+}
+
+template <>
+inline vec4f_t& vec4f_t::operator*=(float scalar)
+{
+	_mm_storeu_ps(data.data(), _mm_mul_ps(_mm_loadu_ps(data.data()), _mm_set1_ps(scalar)));
+	return *this;
+}
+
+template <>
+inline float vec4f_t::dot(const vec4f_t& rhs) const
+{
+	__m128 p = _mm_mul_ps(_mm_loadu_ps(data.data()), _mm_loadu_ps(rhs.data.data()));
+	p = _mm_add_ps(p, _mm_movehl_ps(p, p));
+	p = _mm_add_ss(p, _mm_shuffle_ps(p, p, 0x55));
+	return _mm_cvtss_f32(p);
+}
+#elif defined(SIMD_NEON)
+template <>
+inline vec4f_t& vec4f_t::operator+=(const vec4f_t& rhs)
+{
+	vst1q_f32(data.data(), vaddq_f32(vld1q_f32(data.data()), vld1q_f32(rhs.data.data())));
+	return *this;
+}
+
+template <>
+inline vec4f_t& vec4f_t::operator-=(const vec4f_t& rhs)
+{
+	vst1q_f32(data.data(), vsubq_f32(vld1q_f32(data.data()), vld1q_f32(rhs.data.data())));
+	return *this;
+}
+
+template <>
+inline vec4f_t& vec4f_t::operator*=(float scalar)
+{
+	vst1q_f32(data.data(), vmulq_n_f32(vld1q_f32(data.data()), scalar));
+	return *this;
+}
+
+template <>
+inline float vec4f_t::dot(const vec4f_t& rhs) const
+{
+	return vaddvq_f32(vmulq_f32(vld1q_f32(data.data()), vld1q_f32(rhs.data.data())));
+}
+#endif
+
+#if !defined(SIMD_SCALAR)
+template <>
+inline float vec4f_t::operator*(const vec4f_t& rhs) const
+{
+	return dot(rhs);
+}
+#endif
+
+/** Transform an array of homogeneous vectors: dst[i] = m * src[i]
+ *
+ * @param m: transformation matrix.
+ * @param src: vectors to transform.
+ * @param dst: output array. May be the same as src.
+ * @param n: number of vectors.
+ */
+inline void transform(const mat4x4f_t& m, const vec4f_t *src, vec4f_t *dst, size_t n)
+{
+#if defined(SIMD_SSE)
+	/* dst = col0 * x + col1 * y + col2 * z + col3 * w */
+	__m128 c0 = _mm_loadu_ps(m.data() + 0);
+	__m128 c1 = _mm_loadu_ps(m.data() + 4);
+	__m128 c2 = _mm_loadu_ps(m.data() + 8);
+	__m128 c3 = _mm_loadu_ps(m.data() + 12);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+	for (size_t i = 0; i < n; i++) {
+		__m128 v = _mm_loadu_ps(src[i].data.data());
+		__m128 r = _mm_mul_ps(c0, _mm_shuffle_ps(v, v, 0x00));
+		r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_shuffle_ps(v, v, 0x55)));
+		r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, 0xAA)));
+		r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, 0xFF)));
+		_mm_storeu_ps(dst[i].data.data(), r);
+	}
+#elif defined(SIMD_NEON)
+	float32x4x4_t c = vld4q_f32(m.data()); /* de-interleave: c.val[j] is column j */
+
+	for (size_t i = 0; i < n; i++) {
+		float32x4_t v = vld1q_f32(src[i].data.data());
+		float32x4_t r = vmulq_laneq_f32(c.val[0], v, 0);
+		r = vfmaq_laneq_f32(r, c.val[1], v, 1);
+		r = vfmaq_laneq_f32(r, c.val[2], v, 2);
+		r = vfmaq_laneq_f32(r, c.val[3], v, 3);
+		vst1q_f32(dst[i].data.data(), r);
+	}
+#else
+	for (size_t i = 0; i < n; i++) {
+		vec4f_t v = src[i];
+		for (size_t r = 0; r < 4; r++)
+			dst[i][r] = m(r, 0) * v[0] + m(r, 1) * v[1] + m(r, 2) * v[2] + m(r, 3) * v[3];
+	}
+#endif
+}
+
 #endif /* VEC_H_ */
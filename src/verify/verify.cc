@@ -0,0 +1,248 @@
+#include "verify.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <display/display.h>
+#include <render/render.h>
+
+/* A frame read back from the frame buffer, rows are linear */
+struct image_t {
+	std::vector<uint32_t> pixels;
+	int width;
+	int height;
+};
+
+/* Render a pose and read the frame back */
+static void render_pose(const verify::suite_t& suite, const void *ctx, unsigned pose, image_t& img)
+{
+	render::clear();
+	suite.draw(ctx, pose);
+	render::update();
+	/* a pipelined frame is presented by the next update() or by flush() */
+	render::flush();
+
+	auto fb = display::get_surface();
+	img.width = fb.width;
+	img.height = fb.height;
+	img.pixels.resize((size_t)fb.width * fb.height);
+	for (int y = 0; y < fb.height; y++)
+		fb.read_row(y, &img.pixels[(size_t)y * fb.width]);
+}
+
+/* Largest difference of color channels of two pixels */
+static int difference(uint32_t a, uint32_t b)
+{
+	int d = 0;
+
+	for (int shift = 0; shift < 24; shift += 8)
+		d = std::max(d, std::abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF)));
+	return d;
+}
+
+/* Write a diff image, see verify::run()
+ *
+ * @return 0 on success.
+ */
+static int write_diff(const std::string& name, const image_t& ref, const image_t& img, int channel)
+{
+	std::FILE *f = std::fopen(name.c_str(), "wb");
+	if (!f) {
+		std::fprintf(stderr, "Failed to open \"%s\"\n", name.c_str());
+		return 1;
+	}
+
+	std::fprintf(f, "P6\n%d %d\n255\n", ref.width, ref.height);
+
+	std::vector<uint8_t> row((size_t)ref.width * 3);
+	for (int y = 0; y < ref.height; y++) {
+		for (int x = 0; x < ref.width; x++) {
+			uint32_t a = ref.pixels[(size_t)y * ref.width + x];
+			uint32_t b = img.pixels[(size_t)y * ref.width + x];
+			int d = difference(a, b);
+			uint8_t *p = &row[(size_t)x * 3];
+
+			if (d > channel) {
+				p[0] = 255;
+				p[1] = p[2] = 0;
+			} else if (d) {
+				p[0] = p[1] = 255;
+				p[2] = 0;
+			} else {
+				/* the reference, dimmed to make differences stand out */
+				uint8_t gray = (uint8_t)((((a >> 16) & 0xFF) + ((a >> 8) & 0xFF) + (a & 0xFF)) / 6);
+				p[0] = p[1] = p[2] = gray;
+			}
+		}
+		std::fwrite(row.data(), 1, row.size(), f);
+	}
+
+	return std::fclose(f) ? 1 : 0;
+}
+
+/* Write an image of a baseline
+ *
+ * @return 0 on success.
+ */
+static int write_image(const std::string& name, const image_t& img)
+{
+	std::FILE *f = std::fopen(name.c_str(), "wb");
+	if (!f) {
+		std::fprintf(stderr, "Failed to open \"%s\"\n", name.c_str());
+		return 1;
+	}
+
+	int ret = std::fprintf(f, "P6\n%d %d\n255\n", img.width, img.height) < 0;
+	std::vector<uint8_t> row((size_t)img.width * 3);
+	for (int y = 0; y < img.height && !ret; y++) {
+		for (int x = 0; x < img.width; x++) {
+			uint32_t c = img.pixels[(size_t)y * img.width + x];
+			row[(size_t)x * 3] = (uint8_t)(c >> 16);
+			row[(size_t)x * 3 + 1] = (uint8_t)(c >> 8);
+			row[(size_t)x * 3 + 2] = (uint8_t)c;
+		}
+		ret = std::fwrite(row.data(), 1, row.size(), f) != row.size();
+	}
+	if (std::fclose(f))
+		ret = 1;
+	if (ret)
+		std::fprintf(stderr, "Failed to write \"%s\"\n", name.c_str());
+
+	return ret;
+}
+
+/* Read an image of a baseline written by write_image()
+ *
+ * @return 0 on success.
+ */
+static int read_image(const std::string& name, image_t& img)
+{
+	std::FILE *f = std::fopen(name.c_str(), "rb");
+	if (!f) {
+		std::fprintf(stderr, "Failed to open \"%s\"\n", name.c_str());
+		return 1;
+	}
+
+	int max = 0;
+	int ret = std::fscanf(f, "P6 %d %d %d", &img.width, &img.height, &max) != 3 || max != 255 ||
+		img.width <= 0 || img.height <= 0 || std::fgetc(f) == EOF;
+
+	std::vector<uint8_t> row;
+	if (!ret) {
+		row.resize((size_t)img.width * 3);
+		img.pixels.resize((size_t)img.width * img.height);
+	}
+	for (int y = 0; y < img.height && !ret; y++) {
+		if (std::fread(row.data(), 1, row.size(), f) != row.size()) {
+			ret = 1;
+			break;
+		}
+		for (int x = 0; x < img.width; x++) {
+			const uint8_t *p = &row[(size_t)x * 3];
+			img.pixels[(size_t)y * img.width + x] = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+		}
+	}
+	std::fclose(f);
+	if (ret)
+		std::fprintf(stderr, "Failed to read \"%s\"\n", name.c_str());
+
+	return ret;
+}
+
+/* File name of an image, name is nullptr for baseline images */
+static std::string image_name(const char *prefix, const char *name, const verify::resolution_t& res,
+	unsigned pose)
+{
+	return std::string(prefix) + (name ? std::string(name) + "_" : std::string()) +
+		std::to_string(res.width) + "x" + std::to_string(res.height) + "_" + std::to_string(pose) + ".ppm";
+}
+
+/* Compare an image to the reference, print the result and write a diff image
+ * if it fails, see verify::run()
+ *
+ * @return true if the image passes.
+ */
+static bool compare(const char *name, const verify::resolution_t& res, unsigned pose,
+	const image_t& ref, const image_t& img, const verify::tolerance_t& tolerance, const char *output)
+{
+	if (ref.width != img.width || ref.height != img.height) {
+		std::printf("FAIL %s %dx%d pose %u: %dx%d image\n", name, res.width, res.height, pose,
+			img.width, img.height);
+		return false;
+	}
+
+	size_t mismatched = 0;
+	int max_difference = 0;
+	for (size_t i = 0; i < ref.pixels.size(); i++) {
+		int d = difference(ref.pixels[i], img.pixels[i]);
+		max_difference = std::max(max_difference, d);
+		mismatched += d > tolerance.channel;
+	}
+
+	float fraction = (float)mismatched / (float)ref.pixels.size();
+	bool pass = fraction <= tolerance.pixels;
+	std::printf("%s %s %dx%d pose %u: %zu pixels mismatch (%.3f%%), max difference %d\n",
+		pass ? "PASS" : "FAIL", name, res.width, res.height, pose,
+		mismatched, fraction * 100.f, max_difference);
+
+	if (!pass && output)
+		write_diff(image_name(output, name, res, pose), ref, img, tolerance.channel);
+	return pass;
+}
+
+int verify::run(const suite_t& suite, const char *output, const baseline_t& baseline)
+{
+	std::vector<image_t> refs(suite.poses);
+	std::vector<image_t> mode_refs(suite.poses);
+	image_t img;
+	int failed = 0;
+
+	for (const auto& res : suite.resolutions) {
+		if (render::init(res.width, res.height, true)) {
+			std::fprintf(stderr, "Failed to initialize the renderer at %dx%d\n", res.width, res.height);
+			return -1;
+		}
+
+		suite.reset(suite.ctx);
+		for (unsigned pose = 0; pose < suite.poses; pose++)
+			render_pose(suite, suite.ctx, pose, refs[pose]);
+
+		for (unsigned pose = 0; baseline.prefix && pose < suite.poses; pose++) {
+			std::string name = image_name(baseline.prefix, nullptr, res, pose);
+			if (baseline.write ? write_image(name, refs[pose]) : read_image(name, img)) {
+				render::release();
+				return -1;
+			}
+			if (!baseline.write)
+				failed += !compare("baseline", res, pose, img, refs[pose], baseline.tolerance, output);
+		}
+
+		/* the reference of a mode is drawn once for paths following each other */
+		void (*mode)(void) = nullptr;
+		for (const auto& path : suite.paths) {
+			if (path.mode && path.mode != mode) {
+				suite.reset(suite.ctx);
+				path.mode();
+				for (unsigned pose = 0; pose < suite.poses; pose++)
+					render_pose(suite, suite.ctx, pose, mode_refs[pose]);
+				mode = path.mode;
+			}
+
+			suite.reset(suite.ctx);
+			if (path.mode)
+				path.mode();
+			path.setup();
+
+			for (unsigned pose = 0; pose < suite.poses; pose++) {
+				render_pose(suite, path.ctx, pose, img);
+				failed += !compare(path.name, res, pose, path.mode ? mode_refs[pose] : refs[pose], img,
+					path.tolerance, output);
+			}
+		}
+
+		render::release();
+	}
+
+	return failed;
+}
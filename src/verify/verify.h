@@ -0,0 +1,102 @@
+#ifndef VERIFY_VERIFY_H_
+#define VERIFY_VERIFY_H_
+
+#include <vector>
+
+/* Image equivalence of rendering paths
+ *
+ * Optimized paths of the renderer (fixed point rasterization, pipelining,
+ * threads, ...) must draw the same image as the reference one. A suite
+ * renders a set of poses at a set of resolutions through the reference path
+ * and every optimized path to a headless display, and compares the images.
+ *
+ * Settings which change the image by design (MSAA, resolution scale, ...)
+ * are modes: a path in a mode is compared to the reference drawn in the same
+ * mode. Images of the reference path can be compared to ones written by
+ * another build too, e.g. the SIMD_FORCE_SCALAR one.
+ */
+namespace verify {
+
+/** Allowed difference from the reference image
+ * A pixel mismatches if a color channel differs by more than channel. The
+ * image passes if at most a fraction pixels of its pixels mismatch.
+ */
+struct tolerance_t {
+	int channel;  /**< 0 - 255 */
+	float pixels; /**< 0 - 1 */
+};
+
+/** Bit exact match */
+constexpr tolerance_t EXACT = { 0, 0.f };
+
+/** Draw a pose: called between render::clear() and render::update()
+ *
+ * @param ctx: context of the path.
+ * @param pose: pose number, from 0.
+ */
+using draw_fn = void (*)(const void *ctx, unsigned pose);
+
+/** A rendering path checked against the reference one */
+struct path_t {
+	const char *name;
+	/** Enable the path. Called after the reference settings are applied */
+	void (*setup)(void);
+	tolerance_t tolerance;
+	/** Passed to draw(), e.g. a model to draw */
+	const void *ctx;
+	/** Apply the mode of the path, or nullptr for none. Called after the
+	 * reference settings for both the path and its reference, which is
+	 * drawn with the suite context
+	 */
+	void (*mode)(void) = nullptr;
+};
+
+struct resolution_t {
+	int width;
+	int height;
+};
+
+struct suite_t {
+	std::vector<resolution_t> resolutions;
+	unsigned poses;
+	/** Apply the reference settings and set up the scene. Called with ctx
+	 * after render::init() and before every path
+	 */
+	void (*reset)(const void *ctx);
+	draw_fn draw;
+	/** Passed to draw() for the reference path */
+	const void *ctx;
+	std::vector<path_t> paths;
+};
+
+/** Reference images of another build */
+struct baseline_t {
+	/** Path prefix of the images (<prefix><width>x<height>_<pose>.ppm),
+	 * nullptr for none
+	 */
+	const char *prefix = nullptr;
+	/** Write images of this build instead of comparing to them */
+	bool write = false;
+	tolerance_t tolerance = EXACT;
+};
+
+/** Run a suite
+ * The renderer is initialized with a headless display for every resolution.
+ * A frame is read back after render::update() and render::flush(), so
+ * pipelined paths are compared too. Results are printed to stdout.
+ *
+ * @param suite: the suite.
+ * @param output: path prefix of diff images written for failed comparisons
+ * (<prefix><path>_<width>x<height>_<pose>.ppm) or nullptr to write none.
+ * Matching pixels are dimmed gray, pixels within the tolerance yellow and
+ * mismatching ones red. Diff images of the baseline are named "baseline".
+ * @param baseline: reference images of another build to compare the
+ * reference path to, or to write.
+ * @return number of failed comparisons, -1 if the renderer or baseline
+ * images failed.
+ */
+int run(const suite_t& suite, const char *output, const baseline_t& baseline = {});
+
+} /* namespace verify */
+
+#endif /* VERIFY_VERIFY_H_ */